@@ -0,0 +1,124 @@
+#include "animation.h"
+
+#include <algorithm>
+#include <cmath>
+
+// 2^exponent, past the range of double.
+static FloatExp exp2_floatexp(double exponent)
+{
+    const double whole = std::floor(exponent);
+    return FloatExp::make(std::exp2(exponent - whole), static_cast<int>(whole));
+}
+
+View animation_frame(const View& start, const View& end, int frame, int frames)
+{
+    const double t = frames > 1 ? static_cast<double>(frame) / (frames - 1) : 0.0;
+    const double start_log2 = start.zoom.log2();
+    const double end_log2 = end.zoom.log2();
+
+    View view = start;
+    view.zoom = exp2_floatexp(start_log2 + t * (end_log2 - start_log2));
+
+    // Fraction of the way left to the end center, 1 at start and 0 at end:
+    // (1/zoom - 1/end zoom) / (1/start zoom - 1/end zoom), in FloatExp so it
+    // keeps its precision when tiny, near the end of deep zooms.
+    FloatExp left = 1.0 - t;
+    if (start_log2 != end_log2) {
+        const FloatExp ratio = exp2_floatexp(start_log2 - view.zoom.log2());
+        const FloatExp end_ratio = exp2_floatexp(start_log2 - end_log2);
+        left = (ratio - end_ratio) / (FloatExp(1.0) - end_ratio);
+    }
+    const bool last = frames > 1 && frame == frames - 1;
+    if (last)
+        left = 0.0;
+    for (int k = 0; k < 2; ++k)
+        view.center[k] = end.center[k] + (start.center[k] - end.center[k]) * BigFixed(left);
+    if (last)
+        view.zoom = end.zoom;
+    return view;
+}
+
+// Match the size samples along one axis of the next frame with the
+// from_size samples of the frame before, sampled at from_offset. Sample u of
+// the frame before lands at scale * (u - from_size / 2) + size / 2 + shift in
+// pixels of the next one. source gets the sample closest to each pixel center
+// if it is within max_error, -1 otherwise, and offset where it lies from the
+// pixel center.
+static void match_samples(int size, int from_size, const std::vector<float>& from_offset,
+                          double scale, double shift, double max_error, std::vector<int>& source,
+                          std::vector<float>& offset)
+{
+    source.assign(size, -1);
+    offset.assign(size, 0.0f);
+    auto error = [&](int s, int i) {
+        return scale * (s + 0.5 + from_offset[s] - from_size / 2.0) + size / 2.0 + shift - (i + 0.5);
+    };
+    for (int i = 0; i < size; ++i) {
+        // Samples lie within a pixel of their center, the closest one is next
+        // to the pixel under the center of i.
+        const double under = std::floor((i + 0.5 - size / 2.0 - shift) / scale + from_size / 2.0);
+        if (under < -1.0 || under > from_size)
+            continue;
+        const int first = std::max(static_cast<int>(under) - 1, 0);
+        const int last = std::min(static_cast<int>(under) + 1, from_size - 1);
+        double best = max_error;
+        for (int s = first; s <= last; ++s) {
+            const double e = error(s, i);
+            if (std::fabs(e) <= std::fabs(best)) {
+                best = e;
+                source[i] = s;
+            }
+        }
+        if (source[i] >= 0)
+            offset[i] = static_cast<float>(best);
+    }
+}
+
+long long reproject_frame(const FrameSamples& frame, const View& next, double max_error,
+                          FrameSamples& seeded, std::vector<unsigned char>& keep)
+{
+    const View& from = frame.view;
+    const size_t count = static_cast<size_t>(next.width) * next.height;
+    seeded.view = next;
+    seeded.iters.width = next.width;
+    seeded.iters.height = next.height;
+    seeded.iters.iter.assign(count, 0);
+    keep.assign(count, 0);
+
+    // Positions in pixels of from, from its left or bottom edge, land at
+    // scale * (u - size / 2) + next size / 2 + shift in pixels of next.
+    const FloatExp next_pixels = FloatExp(next.height) * next.zoom / FloatExp(2.0);
+    const double scale = (next_pixels / (FloatExp(from.height) * from.zoom / FloatExp(2.0))).to_double();
+    double shift[2];
+    for (int k = 0; k < 2; ++k)
+        shift[k] = ((from.center[k] - next.center[k]).to_floatexp() * next_pixels).to_double();
+    if (!(scale > 0.0) || !std::isfinite(shift[0]) || !std::isfinite(shift[1])) {
+        seeded.column_offset.assign(next.width, 0.0f);
+        seeded.row_offset.assign(next.height, 0.0f);
+        return 0;
+    }
+
+    std::vector<int> source_x;
+    std::vector<int> source_y;
+    match_samples(next.width, from.width, frame.column_offset, scale, shift[0], max_error,
+                  source_x, seeded.column_offset);
+    match_samples(next.height, from.height, frame.row_offset, scale, shift[1], max_error,
+                  source_y, seeded.row_offset);
+
+    long long kept = 0;
+    for (int y = 0; y < next.height; ++y) {
+        const int sy = source_y[y];
+        if (sy < 0)
+            continue;
+        for (int x = 0; x < next.width; ++x) {
+            const int sx = source_x[x];
+            if (sx < 0)
+                continue;
+            const size_t pixel = static_cast<size_t>(y) * next.width + x;
+            seeded.iters.iter[pixel] = frame.iters.iter[static_cast<size_t>(sy) * from.width + sx];
+            keep[pixel] = 1;
+            ++kept;
+        }
+    }
+    return kept;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+
+#include "fractal.h"
+
+// Zoom animations between two keyframes.
+// Consecutive frames show nearly the same points, so each frame is seeded
+// with the one before moved onto its view: a pixel keeps the iteration count
+// of the previous frame as long as the point that count was computed at stays
+// close enough to its center. Only the others are iterated.
+
+// View of frame [0, frames) of the path from start to end, both included.
+// The zoom grows by the same factor every frame. The center moves like
+// 1 / zoom does, so the end center goes to the middle of the screen in a
+// straight line and at the pace of the zoom, instead of racing across it
+// when the zoom is deep. Size and iterations are those of start.
+View animation_frame(const View& start, const View& end, int frame, int frames);
+
+// Iterations of a frame, and where each column and row was sampled: offset
+// from the pixel center, in pixels of the frame (see
+// RenderOptions::column_offset).
+struct FrameSamples
+{
+    View view;
+    IterBuffer iters;
+    std::vector<float> column_offset;
+    std::vector<float> row_offset;
+};
+
+// Seed the frame of view next from frame, the way XaoS does: each column of
+// next takes the column of frame sampled closest to its center if that is
+// within max_error pixels, at most 1, and each row likewise. Pixels of a
+// taken column and a taken row keep their count and are set in keep (see
+// RenderOptions::keep), the others are left to be iterated where their
+// column and row are sampled. Returns the number of pixels seeded.
+long long reproject_frame(const FrameSamples& frame, const View& next, double max_error,
+                          FrameSamples& seeded, std::vector<unsigned char>& keep);
@@ -0,0 +1,279 @@
+#include "bigfixed.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+
+BigFixed::BigFixed(double value)
+    : BigFixed(std::isfinite(value) ? FloatExp(value) : FloatExp(0.0))
+{
+}
+
+BigFixed::BigFixed(const FloatExp& value)
+{
+    limbs_.assign(1, 0);
+    if (value.mantissa() == 0.0)
+        return;
+
+    negative_ = value.mantissa() < 0.0;
+    int exponent;
+    const double mantissa = std::frexp(std::fabs(value.mantissa()), &exponent);
+    exponent += value.exponent();
+    const uint64_t bits = static_cast<uint64_t>(std::ldexp(mantissa, 53));
+
+    // value = bits * 2^(exponent - 53), keep every bit of it.
+    const int frac_bits = std::max(53 - exponent, 0);
+    resize_fraction((frac_bits + 31) / 32);
+
+    // Integer part wider than 32 bits is not representable.
+    const int shift = exponent - 53 + 32 * frac_limbs();
+    for (int bit = 0; bit < 53; ++bit) {
+        const int pos = shift + bit;
+        if ((bits >> bit) & 1 && pos >= 0 && pos < 32 * static_cast<int>(limbs_.size()))
+            limbs_[pos / 32] |= 1u << (pos % 32);
+    }
+}
+
+bool BigFixed::parse(const std::string& text, BigFixed& value)
+{
+    size_t pos = 0;
+    bool negative = false;
+    if (pos < text.size() && (text[pos] == '-' || text[pos] == '+'))
+        negative = text[pos++] == '-';
+
+    // Collect digits and the position of the decimal point.
+    std::string digits;
+    int point = -1;
+    for (; pos < text.size(); ++pos) {
+        const char c = text[pos];
+        if (std::isdigit(static_cast<unsigned char>(c)))
+            digits += c;
+        else if (c == '.' && point < 0)
+            point = static_cast<int>(digits.size());
+        else
+            break;
+    }
+    if (digits.empty())
+        return false;
+    if (point < 0)
+        point = static_cast<int>(digits.size());
+
+    if (pos < text.size() && (text[pos] == 'e' || text[pos] == 'E')) {
+        char* end = nullptr;
+        const long exponent = std::strtol(text.c_str() + pos + 1, &end, 10);
+        if (end == text.c_str() + pos + 1)
+            return false;
+        pos = end - text.c_str();
+        point += static_cast<int>(exponent);
+    }
+    if (pos != text.size())
+        return false;
+
+    // Move the decimal point inside the digits.
+    if (point < 0) {
+        digits.insert(0, -point, '0');
+        point = 0;
+    }
+    if (point > static_cast<int>(digits.size())) {
+        digits.append(point - digits.size(), '0');
+    }
+
+    uint64_t integer = 0;
+    for (int i = 0; i < point; ++i) {
+        integer = integer * 10 + (digits[i] - '0');
+        if (integer > UINT32_MAX)
+            return false;
+    }
+
+    // Every decimal digit is worth log2(10) bits, plus 64 guard bits.
+    std::vector<int> fraction;
+    for (size_t i = point; i < digits.size(); ++i)
+        fraction.push_back(digits[i] - '0');
+    const int bits = static_cast<int>(std::ceil(fraction.size() * 3.3219280948873623)) + 64;
+
+    BigFixed result;
+    result.limbs_.assign(1, static_cast<uint32_t>(integer));
+    result.resize_fraction((bits + 31) / 32);
+
+    // Multiply the decimal fraction by 2^32 to extract one limb at a time.
+    for (int limb = result.frac_limbs() - 1; limb >= 0; --limb) {
+        uint64_t carry = 0;
+        for (size_t i = fraction.size(); i-- > 0;) {
+            const uint64_t product = static_cast<uint64_t>(fraction[i]) * 4294967296ull + carry;
+            fraction[i] = static_cast<int>(product % 10);
+            carry = product / 10;
+        }
+        result.limbs_[limb] = static_cast<uint32_t>(carry);
+    }
+
+    result.negative_ = negative && !result.is_zero();
+    value = std::move(result);
+    return true;
+}
+
+double BigFixed::to_double() const
+{
+    // Least significant first so small limbs are not lost in rounding.
+    double result = 0.0;
+    for (int i = 0; i < static_cast<int>(limbs_.size()); ++i)
+        result += std::ldexp(static_cast<double>(limbs_[i]), 32 * (i - frac_limbs()));
+    return negative_ ? -result : result;
+}
+
+FloatExp BigFixed::to_floatexp() const
+{
+    // The top limb that is not zero and the two below it hold more bits
+    // than a double mantissa.
+    int top = static_cast<int>(limbs_.size()) - 1;
+    while (top >= 0 && limbs_[top] == 0)
+        --top;
+    FloatExp result = 0.0;
+    for (int i = std::max(top - 2, 0); i <= top; ++i)
+        result += FloatExp::make(static_cast<double>(limbs_[i]), 32 * (i - frac_limbs()));
+    return negative_ ? -result : result;
+}
+
+std::string BigFixed::to_string(int digits) const
+{
+    std::string text = negative_ ? "-" : "";
+    text += std::to_string(limbs_.empty() ? 0u : limbs_.back());
+    if (digits <= 0)
+        return text;
+
+    // Multiply the binary fraction by 10 to extract one digit at a time.
+    std::vector<uint32_t> fraction(limbs_.begin(), limbs_.end() - (limbs_.empty() ? 0 : 1));
+    text += '.';
+    for (int d = 0; d < digits; ++d) {
+        uint64_t carry = 0;
+        for (uint32_t& limb : fraction) {
+            const uint64_t product = static_cast<uint64_t>(limb) * 10 + carry;
+            limb = static_cast<uint32_t>(product);
+            carry = product >> 32;
+        }
+        text += static_cast<char>('0' + carry);
+    }
+    return text;
+}
+
+void BigFixed::set_precision(int bits)
+{
+    resize_fraction((std::max(bits, 0) + 31) / 32);
+}
+
+void BigFixed::resize_fraction(int frac_limbs)
+{
+    if (limbs_.empty())
+        limbs_.assign(1, 0);
+
+    const int current = this->frac_limbs();
+    if (frac_limbs > current)
+        limbs_.insert(limbs_.begin(), frac_limbs - current, 0);
+    else if (frac_limbs < current)
+        limbs_.erase(limbs_.begin(), limbs_.begin() + (current - frac_limbs));
+}
+
+bool BigFixed::is_zero() const
+{
+    return std::all_of(limbs_.begin(), limbs_.end(), [](uint32_t limb) { return limb == 0; });
+}
+
+BigFixed BigFixed::operator-() const
+{
+    BigFixed result = *this;
+    result.negative_ = !negative_ && !is_zero();
+    return result;
+}
+
+void BigFixed::add_magnitude(const BigFixed& other, bool subtract)
+{
+    // Align both fractions on the most precise one.
+    const int frac = std::max(frac_limbs(), other.frac_limbs());
+    resize_fraction(frac);
+    const int offset = frac - other.frac_limbs();
+    auto other_limb = [&](int i) -> uint64_t {
+        const int j = i - offset;
+        return j >= 0 && j < static_cast<int>(other.limbs_.size()) ? other.limbs_[j] : 0;
+    };
+
+    if (!subtract) {
+        uint64_t carry = 0;
+        for (size_t i = 0; i < limbs_.size(); ++i) {
+            const uint64_t sum = limbs_[i] + other_limb(static_cast<int>(i)) + carry;
+            limbs_[i] = static_cast<uint32_t>(sum);
+            carry = sum >> 32;
+        }
+        return;
+    }
+
+    // Subtract the smaller magnitude from the larger one.
+    bool other_larger = false;
+    for (size_t i = limbs_.size(); i-- > 0;) {
+        const uint64_t b = other_limb(static_cast<int>(i));
+        if (limbs_[i] != b) {
+            other_larger = b > limbs_[i];
+            break;
+        }
+    }
+
+    int64_t borrow = 0;
+    for (size_t i = 0; i < limbs_.size(); ++i) {
+        const int64_t a = other_larger ? static_cast<int64_t>(other_limb(static_cast<int>(i))) : limbs_[i];
+        const int64_t b = other_larger ? limbs_[i] : static_cast<int64_t>(other_limb(static_cast<int>(i)));
+        int64_t diff = a - b - borrow;
+        borrow = diff < 0;
+        if (diff < 0)
+            diff += 4294967296ll;
+        limbs_[i] = static_cast<uint32_t>(diff);
+    }
+    if (other_larger)
+        negative_ = !negative_;
+    if (is_zero())
+        negative_ = false;
+}
+
+BigFixed& BigFixed::operator+=(const BigFixed& other)
+{
+    add_magnitude(other, negative_ != other.negative_);
+    return *this;
+}
+
+BigFixed& BigFixed::operator-=(const BigFixed& other)
+{
+    add_magnitude(other, negative_ == other.negative_);
+    return *this;
+}
+
+BigFixed operator*(const BigFixed& a, const BigFixed& b)
+{
+    if (a.limbs_.empty() || b.limbs_.empty())
+        return BigFixed();
+
+    // Full product, its binary point is after the fractions of both.
+    const size_t na = a.limbs_.size();
+    const size_t nb = b.limbs_.size();
+    std::vector<uint64_t> product(na + nb, 0);
+    for (size_t i = 0; i < na; ++i) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < nb; ++j) {
+            const uint64_t t = static_cast<uint64_t>(a.limbs_[i]) * b.limbs_[j] + product[i + j] + carry;
+            product[i + j] = t & 0xffffffffu;
+            carry = t >> 32;
+        }
+        product[i + nb] += carry;
+    }
+
+    // Keep the precision of the most precise operand, truncating the rest.
+    BigFixed result;
+    const int frac = std::max(a.frac_limbs(), b.frac_limbs());
+    const int drop = a.frac_limbs() + b.frac_limbs() - frac;
+    result.limbs_.resize(frac + 1);
+    for (int i = 0; i <= frac; ++i)
+        result.limbs_[i] = static_cast<uint32_t>(product[drop + i]);
+    result.negative_ = (a.negative_ != b.negative_) && !result.is_zero();
+    return result;
+}
+
+int precision_for_zoom(const FloatExp& zoom)
+{
+    return static_cast<int>(std::ceil(std::max(zoom.log2(), 0.0))) + 64;
+}
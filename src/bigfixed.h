@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "floatexp.h"
+
+// Arbitrary precision signed fixed-point number, used for view centers and
+// reference orbits past the reach of double.
+// 32 integer bits, and as many 32-bit fraction limbs as the value needs.
+// Results take the precision of the most precise operand.
+class BigFixed
+{
+public:
+    BigFixed() = default;
+    BigFixed(double value);
+    // Exact, with as many fraction bits as value needs, even past double.
+    explicit BigFixed(const FloatExp& value);
+
+    // Parse a decimal number such as "-0.743643887037151" or "1.5e-20".
+    // Precision is set to hold every given digit.
+    static bool parse(const std::string& text, BigFixed& value);
+
+    double to_double() const;
+    // Rounded to double precision, without underflow.
+    FloatExp to_floatexp() const;
+    std::string to_string(int digits) const;
+
+    bool negative() const { return negative_; }
+    int precision_bits() const { return 32 * frac_limbs(); }
+
+    // Extend (or truncate) the fraction to at least bits bits.
+    void set_precision(int bits);
+
+    BigFixed operator-() const;
+    BigFixed& operator+=(const BigFixed& other);
+    BigFixed& operator-=(const BigFixed& other);
+
+    friend BigFixed operator+(BigFixed a, const BigFixed& b) { return a += b; }
+    friend BigFixed operator-(BigFixed a, const BigFixed& b) { return a -= b; }
+    friend BigFixed operator*(const BigFixed& a, const BigFixed& b);
+
+private:
+    int frac_limbs() const { return limbs_.empty() ? 0 : static_cast<int>(limbs_.size()) - 1; }
+    void resize_fraction(int frac_limbs);
+    void add_magnitude(const BigFixed& other, bool subtract);
+    bool is_zero() const;
+
+    // Little-endian limbs, the last one is the integer part.
+    std::vector<uint32_t> limbs_;
+    bool negative_ = false;
+};
+
+// Bits of precision needed to tell pixels apart at zoom, with margin for
+// the rounding accumulated along an orbit.
+int precision_for_zoom(const FloatExp& zoom);
@@ -0,0 +1,72 @@
+#include "bla.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "perturbation.h"
+
+template <typename T>
+static T magnitude(const T& x, const T& y)
+{
+    using std::sqrt;
+    return sqrt(x * x + y * y);
+}
+
+template <typename T>
+void BlaTable<T>::build(const ReferenceOrbit& orbit, T dc_max, double epsilon)
+{
+    levels_.clear();
+    dc_max_ = dc_max;
+    max_r2_ = 0.0;
+
+    // Steps must not run past the last reference point.
+    const int steps = orbit.length() - 2;
+    if (steps < 1)
+        return;
+
+    // dz^2 is dropped. While |dz| + |A dz + B dc| < epsilon |Z| it is below
+    // epsilon |Z dz|, and the next dz is as small next to the next Z, which
+    // bounds the radius with the dc term included:
+    //     r = max(0, epsilon |Z| - |B| dc_max) / (|A| + 1)
+    std::vector<BlaStep<T>> single(steps);
+    for (int i = 0; i < steps; ++i) {
+        const int m = i + 1;
+        BlaStep<T>& step = single[i];
+        step.ax = 2.0 * orbit.x[m];
+        step.ay = 2.0 * orbit.y[m];
+        step.bx = 1.0;
+        step.by = 0.0;
+        const T z = magnitude(T(orbit.x[m]), T(orbit.y[m]));
+        const T r = std::max(T(0.0), T(epsilon) * z - dc_max) / (T(2.0) * z + T(1.0));
+        step.r2 = r * r;
+        step.length = 1;
+    }
+    levels_.push_back(std::move(single));
+
+    // Step x followed by step y:
+    //     A = Ay Ax,  B = Ay Bx + By,  r = min(rx, (ry - |Bx| dc_max) / |Ax|)
+    while (levels_.back().size() >= 2) {
+        const std::vector<BlaStep<T>>& lower = levels_.back();
+        std::vector<BlaStep<T>> upper(lower.size() / 2);
+        for (size_t j = 0; j < upper.size(); ++j) {
+            const BlaStep<T>& x = lower[2 * j];
+            const BlaStep<T>& y = lower[2 * j + 1];
+            BlaStep<T>& step = upper[j];
+            step.ax = y.ax * x.ax - y.ay * x.ay;
+            step.ay = y.ax * x.ay + y.ay * x.ax;
+            step.bx = y.ax * x.bx - y.ay * x.by + y.bx;
+            step.by = y.ax * x.by + y.ay * x.bx + y.by;
+
+            using std::sqrt;
+            const T ry = sqrt(y.r2) - magnitude(x.bx, x.by) * dc_max;
+            const T r = std::min(sqrt(x.r2), std::max(T(0.0), ry / magnitude(x.ax, x.ay)));
+            step.r2 = r * r;
+            step.length = x.length + y.length;
+            max_r2_ = std::max(max_r2_, step.r2);
+        }
+        levels_.push_back(std::move(upper));
+    }
+}
+
+template class BlaTable<double>;
+template class BlaTable<FloatExp>;
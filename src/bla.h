@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "floatexp.h"
+
+struct ReferenceOrbit;
+
+// Bilinear approximation (BLA) of the perturbation iteration.
+// While dz is small next to Z, dz_n+1 = 2 Z_n dz_n + dc is linear in dz and
+// dc, so l iterations from reference index m collapse into
+//     dz_m+l = A dz_m + B dc
+// valid as long as |dz_m| < r. Level k of the table holds the steps of 2^k
+// iterations starting at m = 1 + j 2^k, merged pairwise from level k - 1.
+// T is the type of the deltas, double or FloatExp past the range of double.
+
+// The rounding error of double: steps then err no more than the iterations
+// of plain perturbation they replace.
+static constexpr double BLA_EPSILON = 1.0 / 9007199254740992.0; // 2^-53
+
+template <typename T>
+struct BlaStep
+{
+    T ax = 0.0;
+    T ay = 0.0;
+    T bx = 0.0;
+    T by = 0.0;
+    T r2 = 0.0; // squared validity radius
+    int length = 0;
+};
+
+template <typename T>
+class BlaTable
+{
+public:
+    // dc_max bounds the pixel offsets the table will be used with. epsilon is
+    // the error allowed per iteration, relative to |Z dz|.
+    void build(const ReferenceOrbit& orbit, T dc_max, double epsilon = BLA_EPSILON);
+
+    // Longest step starting at reference index m, valid for |dz|^2 = dz2 and
+    // at most max_length iterations long. Single iterations are never
+    // returned, those are computed exactly.
+    const BlaStep<T>* lookup(int m, const T& dz2, int max_length) const
+    {
+        // Past the widest step, which most iterations of shallow views are.
+        const int p = m - 1;
+        if (p < 0 || dz2 >= max_r2_)
+            return nullptr;
+
+        // Steps of level k only start at multiples of 2^k.
+        int top = static_cast<int>(levels_.size()) - 1;
+        if (p > 0)
+            top = std::min(top, count_trailing_zeros(p));
+
+        // A merged step is never valid further than its first half, so the
+        // search stops at the first level that does not fit.
+        const BlaStep<T>* best = nullptr;
+        for (int k = 1; k <= top; ++k) {
+            const size_t j = static_cast<size_t>(p) >> k;
+            if (j >= levels_[k].size())
+                break;
+            const BlaStep<T>& step = levels_[k][j];
+            if (step.length > max_length || dz2 >= step.r2)
+                break;
+            best = &step;
+        }
+        return best;
+    }
+
+    T dc_max() const { return dc_max_; }
+    int level_count() const { return static_cast<int>(levels_.size()); }
+    const std::vector<BlaStep<T>>& level(int k) const { return levels_[k]; }
+
+private:
+    static int count_trailing_zeros(int value)
+    {
+        int count = 0;
+        while (!(value & 1)) {
+            value >>= 1;
+            ++count;
+        }
+        return count;
+    }
+
+    std::vector<std::vector<BlaStep<T>>> levels_;
+    T dc_max_ = 0.0;
+    T max_r2_ = 0.0; // largest r2 of levels 1 and up
+};
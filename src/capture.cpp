@@ -0,0 +1,151 @@
+#include "capture.h"
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+
+#include "stb_image_write.h"
+
+FrameCapture::FrameCapture(int width, int height)
+    : width_(width), height_(height)
+{
+    const GLsizeiptr size = static_cast<GLsizeiptr>(width) * height * 3;
+    for (Slot& slot : slots_) {
+        glGenBuffers(1, &slot.pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    writer_ = std::thread(&FrameCapture::write_images, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+    close();
+}
+
+bool FrameCapture::request(const std::string& file)
+{
+    Slot& slot = slots_[next_slot_];
+    if (slot.fence)
+        return false;
+
+    // Returns at once, the copy lands in the buffer later.
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    glReadPixels(0, 0, width_, height_, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.file = file;
+
+    next_slot_ = (next_slot_ + 1) % RING_SIZE;
+    return true;
+}
+
+void FrameCapture::poll()
+{
+    for (Slot& slot : slots_) {
+        if (!slot.fence)
+            continue;
+        const GLenum status = glClientWaitSync(slot.fence, 0, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+            retire(slot);
+    }
+}
+
+bool FrameCapture::pending() const
+{
+    for (const Slot& slot : slots_) {
+        if (slot.fence)
+            return true;
+    }
+    return false;
+}
+
+void FrameCapture::retire(Slot& slot)
+{
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+
+    Job job;
+    job.file = std::move(slot.file);
+    job.rgb.resize(static_cast<size_t>(width_) * height_ * 3);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, job.rgb.size(), GL_MAP_READ_BIT);
+    if (pixels) {
+        std::copy(static_cast<const unsigned char*>(pixels),
+                  static_cast<const unsigned char*>(pixels) + job.rgb.size(), job.rgb.begin());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!pixels) {
+        std::cout << "Unable to read back " << job.file << "\n";
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_.push_back(std::move(job));
+    wake_.notify_one();
+}
+
+void FrameCapture::close()
+{
+    if (!writer_.joinable())
+        return;
+
+    for (Slot& slot : slots_) {
+        if (slot.fence) {
+            glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(-1));
+            retire(slot);
+        }
+        glDeleteBuffers(1, &slot.pbo);
+        slot.pbo = 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+}
+
+void FrameCapture::write_images()
+{
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+            if (jobs_.empty())
+                return;
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+
+        // Rows are bottom to top as read, like the PNGs of render.
+        const int stride = width_ * 3;
+        if (stbi_write_png(job.file.c_str(), width_, height_, 3, job.rgb.data(), stride))
+            std::cout << "Saved image " << job.file << std::endl;
+        else
+            std::cout << "Unable to write file " << job.file << std::endl;
+    }
+}
+
+std::string unique_capture_name(const std::string& prefix)
+{
+    char stamp[32];
+    const std::time_t now = std::time(nullptr);
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+
+    // Captures still being written have no file yet, the count tells them
+    // apart within a second.
+    static int count = 0;
+    for (;;) {
+        const std::string name = prefix + "-" + stamp + "-" + std::to_string(++count) + ".png";
+        if (!std::ifstream(name))
+            return name;
+    }
+}
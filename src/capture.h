@@ -0,0 +1,72 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glad/glad.h"
+
+// Screen captures that do not stall the render loop.
+// glReadPixels goes into one of a ring of pixel buffer objects, so the copy
+// runs on the GPU while the loop goes on. A fence tells when it is done,
+// then the pixels are handed to a worker thread that encodes the PNG.
+class FrameCapture
+{
+public:
+    static constexpr int RING_SIZE = 3;
+
+    // Needs the GL context current, as every other call does.
+    FrameCapture(int width, int height);
+    ~FrameCapture();
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    // Start reading the color buffer being drawn into file. False when
+    // every buffer of the ring is still busy.
+    bool request(const std::string& file);
+
+    // Pass the readbacks that completed to the writer. Once per frame.
+    void poll();
+
+    // Whether readbacks are waiting for the GPU, then poll() is still due.
+    bool pending() const;
+
+    // Write every capture requested so far, then stop the writer. Called
+    // before the GL context goes away.
+    void close();
+
+private:
+    struct Slot
+    {
+        GLuint pbo = 0;
+        GLsync fence = nullptr;
+        std::string file;
+    };
+
+    struct Job
+    {
+        std::string file;
+        std::vector<unsigned char> rgb;
+    };
+
+    void retire(Slot& slot);
+    void write_images();
+
+    int width_;
+    int height_;
+    Slot slots_[RING_SIZE];
+    int next_slot_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<Job> jobs_;
+    bool stopping_ = false;
+    std::thread writer_;
+};
+
+// Name for a new capture that no file in the working directory has yet,
+// such as capture-20210703-154210-1.png. Numbers go on across seconds.
+std::string unique_capture_name(const std::string& prefix = "capture");
@@ -0,0 +1,52 @@
+#version 400 core
+
+// Second pass: colors the iteration counts left in u_iterations by
+// frag.glsl, frag64.glsl or frag_perturb.glsl. Changing the palette only
+// runs this pass again, no orbit is iterated.
+
+out vec4 frag_color;
+
+uniform sampler2D u_iterations; // (escape iteration, smooth iteration)
+uniform int u_max_iter;
+uniform int u_palette;
+uniform float u_exposure; // scales iterations before they are mapped to colors
+uniform bool u_smooth;    // smooth iteration count instead of bands
+uniform ivec2 u_step;     // grid of the pixels iterated so far, see frag.glsl
+
+vec3 C1 = vec3(0.4, 0.0, 0.0);
+vec3 C2 = vec3(1.0, 1.0, 0.0);
+
+// Cosine gradient, one cycle when t goes through 1.
+vec3 cosine_palette(float t, vec3 phase)
+{
+    return vec3(0.5) + vec3(0.5) * cos(6.2831853 * (vec3(t) + phase));
+}
+
+void main()
+{
+    // While refining, pixels not iterated yet show the nearest one below
+    // and to the left that is.
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec2 iterations = texelFetch(u_iterations, pixel - pixel % u_step, 0).xy;
+
+    // If reaches here, the point is considered in the set
+    if (iterations.x >= float(u_max_iter)) {
+        frag_color = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+
+    float n = u_smooth ? max(iterations.y, 0.0) : iterations.x;
+    vec3 color;
+    if (u_palette == 1) {
+        // Cycles every 64 iterations, for deep zooms with many bands.
+        color = cosine_palette(n * u_exposure / 64.0, vec3(0.0, 0.1, 0.2));
+    }
+    else if (u_palette == 2) {
+        color = cosine_palette(n * u_exposure / 32.0, vec3(0.0));
+    }
+    else {
+        float t = min(n / u_max_iter * u_exposure, 1.0);
+        color = (1.0-t) * C1 + t * C2;
+    }
+    frag_color = vec4(color, 1.0);
+}
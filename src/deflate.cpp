@@ -0,0 +1,464 @@
+#include "deflate.h"
+
+#include <algorithm>
+#include <queue>
+
+namespace {
+
+constexpr int WINDOW_SIZE = 32768;
+constexpr int MIN_MATCH = 3;
+constexpr int MAX_MATCH = 258;
+constexpr int HASH_BITS = 15;
+// Candidates tried per position, and a match long enough to stop looking.
+// Rendered images repeat a lot, short chains find most of it.
+constexpr int MAX_CHAIN = 32;
+constexpr int NICE_MATCH = 128;
+// Symbols per Huffman block, so codes follow changes along the data.
+constexpr size_t BLOCK_SYMBOLS = 1 << 16;
+
+constexpr int LITLEN_CODES = 286;
+constexpr int DIST_CODES = 30;
+constexpr int CODE_LENGTH_CODES = 19;
+constexpr int END_OF_BLOCK = 256;
+
+const uint16_t LENGTH_BASE[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                  31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                  2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t DIST_BASE[30] = {1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+                                33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+                                1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const uint8_t DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+const uint8_t CODE_LENGTH_ORDER[CODE_LENGTH_CODES] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                                      11, 4,  12, 3, 13, 2, 14, 1, 15};
+
+// A literal when dist is 0, otherwise a match of length litlen.
+struct Symbol
+{
+    uint16_t litlen;
+    uint16_t dist;
+};
+
+struct CodeTables
+{
+    uint8_t length_code[MAX_MATCH + 1];
+    uint8_t dist_code[WINDOW_SIZE + 1];
+
+    CodeTables()
+    {
+        for (int code = 0; code < 29; ++code) {
+            const int last = code == 28 ? MAX_MATCH : LENGTH_BASE[code + 1] - 1;
+            for (int length = LENGTH_BASE[code]; length <= last; ++length)
+                length_code[length] = static_cast<uint8_t>(code);
+        }
+        for (int code = 0; code < DIST_CODES; ++code) {
+            const int last = code == DIST_CODES - 1 ? WINDOW_SIZE : DIST_BASE[code + 1] - 1;
+            for (int dist = DIST_BASE[code]; dist <= last; ++dist)
+                dist_code[dist] = static_cast<uint8_t>(code);
+        }
+    }
+};
+
+const CodeTables& code_tables()
+{
+    static const CodeTables tables;
+    return tables;
+}
+
+// Bits go out least significant first, as deflate packs them.
+class BitWriter
+{
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out_(out) {}
+
+    void put(uint32_t value, int count)
+    {
+        bits_ |= static_cast<uint64_t>(value) << count_;
+        count_ += count;
+        while (count_ >= 8) {
+            out_.push_back(static_cast<uint8_t>(bits_));
+            bits_ >>= 8;
+            count_ -= 8;
+        }
+    }
+
+    void align()
+    {
+        if (count_ > 0)
+            out_.push_back(static_cast<uint8_t>(bits_));
+        bits_ = 0;
+        count_ = 0;
+    }
+
+private:
+    std::vector<uint8_t>& out_;
+    uint64_t bits_ = 0;
+    int count_ = 0;
+};
+
+// Huffman code lengths for freq, none longer than limit. Frequencies are
+// halved until the tree is shallow enough, which costs little on real data.
+// At least two symbols get a code, inflaters reject single code trees.
+void build_lengths(const uint32_t* freq, int count, int limit, uint8_t* lengths)
+{
+    std::vector<uint32_t> weights(freq, freq + count);
+    int used = 0;
+    for (int i = 0; i < count; ++i)
+        used += weights[i] > 0;
+    for (int i = 0; used < 2 && i < count; ++i) {
+        if (weights[i] == 0) {
+            weights[i] = 1;
+            ++used;
+        }
+    }
+
+    struct Node
+    {
+        uint32_t weight;
+        int left;
+        int right;
+    };
+    using Entry = std::pair<uint32_t, int>;
+
+    for (;;) {
+        std::vector<Node> nodes;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+        std::vector<int> leaf_symbol;
+        for (int i = 0; i < count; ++i) {
+            if (weights[i] == 0)
+                continue;
+            queue.push({weights[i], static_cast<int>(nodes.size())});
+            nodes.push_back({weights[i], -1, -1});
+            leaf_symbol.push_back(i);
+        }
+        while (queue.size() > 1) {
+            const Entry a = queue.top();
+            queue.pop();
+            const Entry b = queue.top();
+            queue.pop();
+            queue.push({a.first + b.first, static_cast<int>(nodes.size())});
+            nodes.push_back({a.first + b.first, a.second, b.second});
+        }
+
+        std::fill(lengths, lengths + count, 0);
+        int deepest = 0;
+        std::vector<std::pair<int, int>> stack = {{queue.top().second, 0}};
+        while (!stack.empty()) {
+            const auto [node, depth] = stack.back();
+            stack.pop_back();
+            if (nodes[node].left < 0) {
+                lengths[leaf_symbol[node]] = static_cast<uint8_t>(depth);
+                deepest = std::max(deepest, depth);
+                continue;
+            }
+            stack.push_back({nodes[node].left, depth + 1});
+            stack.push_back({nodes[node].right, depth + 1});
+        }
+        if (deepest <= limit)
+            return;
+
+        for (uint32_t& weight : weights) {
+            if (weight > 0)
+                weight = (weight + 1) / 2;
+        }
+    }
+}
+
+// Canonical codes for lengths, bit reversed to be written LSB first.
+void build_codes(const uint8_t* lengths, int count, uint16_t* codes)
+{
+    int length_count[16] = {};
+    for (int i = 0; i < count; ++i)
+        ++length_count[lengths[i]];
+    length_count[0] = 0;
+
+    int next_code[16] = {};
+    int code = 0;
+    for (int bits = 1; bits < 16; ++bits) {
+        code = (code + length_count[bits - 1]) << 1;
+        next_code[bits] = code;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        const int length = lengths[i];
+        if (length == 0)
+            continue;
+        uint32_t value = next_code[length]++;
+        uint32_t reversed = 0;
+        for (int bit = 0; bit < length; ++bit) {
+            reversed = (reversed << 1) | (value & 1);
+            value >>= 1;
+        }
+        codes[i] = static_cast<uint16_t>(reversed);
+    }
+}
+
+void write_block(const std::vector<Symbol>& symbols, bool final, BitWriter& bits)
+{
+    const CodeTables& tables = code_tables();
+
+    uint32_t litlen_freq[LITLEN_CODES] = {};
+    uint32_t dist_freq[DIST_CODES] = {};
+    for (const Symbol& symbol : symbols) {
+        if (symbol.dist == 0) {
+            ++litlen_freq[symbol.litlen];
+        }
+        else {
+            ++litlen_freq[257 + tables.length_code[symbol.litlen]];
+            ++dist_freq[tables.dist_code[symbol.dist]];
+        }
+    }
+    litlen_freq[END_OF_BLOCK] = 1;
+
+    uint8_t litlen_lengths[LITLEN_CODES] = {};
+    uint8_t dist_lengths[DIST_CODES] = {};
+    build_lengths(litlen_freq, LITLEN_CODES, 15, litlen_lengths);
+    build_lengths(dist_freq, DIST_CODES, 15, dist_lengths);
+
+    int litlen_count = LITLEN_CODES;
+    while (litlen_count > 257 && litlen_lengths[litlen_count - 1] == 0)
+        --litlen_count;
+    int dist_count = DIST_CODES;
+    while (dist_count > 1 && dist_lengths[dist_count - 1] == 0)
+        --dist_count;
+    uint8_t lengths[LITLEN_CODES + DIST_CODES];
+    std::copy(litlen_lengths, litlen_lengths + litlen_count, lengths);
+    std::copy(dist_lengths, dist_lengths + dist_count, lengths + litlen_count);
+
+    // Both code lengths tables run length encoded as one sequence: 16 repeats
+    // the previous length 3-6 times, 17 and 18 give runs of zeros.
+    struct CodeLength
+    {
+        uint8_t symbol;
+        uint8_t extra;
+    };
+    std::vector<CodeLength> encoded;
+    const int total = litlen_count + dist_count;
+    for (int i = 0; i < total;) {
+        const uint8_t value = lengths[i];
+        int run = 1;
+        while (i + run < total && lengths[i + run] == value)
+            ++run;
+        i += run;
+
+        if (value == 0) {
+            while (run >= 11) {
+                const int n = std::min(run, 138);
+                encoded.push_back({18, static_cast<uint8_t>(n - 11)});
+                run -= n;
+            }
+            if (run >= 3) {
+                encoded.push_back({17, static_cast<uint8_t>(run - 3)});
+                run = 0;
+            }
+        }
+        else {
+            encoded.push_back({value, 0});
+            --run;
+            while (run >= 3) {
+                const int n = std::min(run, 6);
+                encoded.push_back({16, static_cast<uint8_t>(n - 3)});
+                run -= n;
+            }
+        }
+        for (; run > 0; --run)
+            encoded.push_back({value, 0});
+    }
+
+    uint32_t code_length_freq[CODE_LENGTH_CODES] = {};
+    for (const CodeLength& code_length : encoded)
+        ++code_length_freq[code_length.symbol];
+    uint8_t code_length_lengths[CODE_LENGTH_CODES] = {};
+    build_lengths(code_length_freq, CODE_LENGTH_CODES, 7, code_length_lengths);
+    uint16_t code_length_codes[CODE_LENGTH_CODES] = {};
+    build_codes(code_length_lengths, CODE_LENGTH_CODES, code_length_codes);
+    int header_count = CODE_LENGTH_CODES;
+    while (header_count > 4 && code_length_lengths[CODE_LENGTH_ORDER[header_count - 1]] == 0)
+        --header_count;
+
+    uint16_t litlen_codes[LITLEN_CODES] = {};
+    uint16_t dist_codes[DIST_CODES] = {};
+    build_codes(litlen_lengths, LITLEN_CODES, litlen_codes);
+    build_codes(dist_lengths, DIST_CODES, dist_codes);
+
+    bits.put(final ? 1 : 0, 1);
+    bits.put(2, 2); // dynamic Huffman codes
+    bits.put(litlen_count - 257, 5);
+    bits.put(dist_count - 1, 5);
+    bits.put(header_count - 4, 4);
+    for (int i = 0; i < header_count; ++i)
+        bits.put(code_length_lengths[CODE_LENGTH_ORDER[i]], 3);
+    for (const CodeLength& code_length : encoded) {
+        bits.put(code_length_codes[code_length.symbol], code_length_lengths[code_length.symbol]);
+        if (code_length.symbol == 16)
+            bits.put(code_length.extra, 2);
+        else if (code_length.symbol == 17)
+            bits.put(code_length.extra, 3);
+        else if (code_length.symbol == 18)
+            bits.put(code_length.extra, 7);
+    }
+
+    for (const Symbol& symbol : symbols) {
+        if (symbol.dist == 0) {
+            bits.put(litlen_codes[symbol.litlen], litlen_lengths[symbol.litlen]);
+            continue;
+        }
+        const int length_code = tables.length_code[symbol.litlen];
+        bits.put(litlen_codes[257 + length_code], litlen_lengths[257 + length_code]);
+        bits.put(symbol.litlen - LENGTH_BASE[length_code], LENGTH_EXTRA[length_code]);
+        const int dist_code = tables.dist_code[symbol.dist];
+        bits.put(dist_codes[dist_code], dist_lengths[dist_code]);
+        bits.put(symbol.dist - DIST_BASE[dist_code], DIST_EXTRA[dist_code]);
+    }
+    bits.put(litlen_codes[END_OF_BLOCK], litlen_lengths[END_OF_BLOCK]);
+}
+
+uint32_t hash3(const uint8_t* p)
+{
+    const uint32_t value = p[0] | (p[1] << 8) | (p[2] << 16);
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+} // namespace
+
+void deflate_piece(const uint8_t* data, size_t size, bool last, std::vector<uint8_t>& out)
+{
+    BitWriter bits(out);
+
+    // Most recent position of each hash, and the one before it with the same
+    // hash for every position of the window.
+    std::vector<int64_t> head(size_t(1) << HASH_BITS, -1);
+    std::vector<int64_t> prev(WINDOW_SIZE, -1);
+    auto insert = [&](size_t pos) {
+        const uint32_t hash = hash3(data + pos);
+        prev[pos & (WINDOW_SIZE - 1)] = head[hash];
+        head[hash] = static_cast<int64_t>(pos);
+    };
+
+    std::vector<Symbol> symbols;
+    symbols.reserve(BLOCK_SYMBOLS);
+    size_t pos = 0;
+    while (pos < size) {
+        int best_length = 0;
+        int best_dist = 0;
+        if (pos + MIN_MATCH <= size) {
+            const int limit = static_cast<int>(std::min<size_t>(MAX_MATCH, size - pos));
+            int64_t candidate = head[hash3(data + pos)];
+            for (int chain = 0; chain < MAX_CHAIN && candidate >= 0; ++chain) {
+                const size_t dist = pos - static_cast<size_t>(candidate);
+                if (dist > WINDOW_SIZE)
+                    break;
+                const uint8_t* a = data + candidate;
+                const uint8_t* b = data + pos;
+                if (a[best_length] == b[best_length]) {
+                    int length = 0;
+                    while (length < limit && a[length] == b[length])
+                        ++length;
+                    if (length > best_length) {
+                        best_length = length;
+                        best_dist = static_cast<int>(dist);
+                        if (length >= NICE_MATCH || length == limit)
+                            break;
+                    }
+                }
+                // Slots of the window are reused, stop at a newer position.
+                const int64_t next = prev[candidate & (WINDOW_SIZE - 1)];
+                if (next >= candidate)
+                    break;
+                candidate = next;
+            }
+            insert(pos);
+        }
+
+        if (best_length >= MIN_MATCH) {
+            symbols.push_back({static_cast<uint16_t>(best_length), static_cast<uint16_t>(best_dist)});
+            for (size_t i = pos + 1; i < pos + best_length && i + MIN_MATCH <= size; ++i)
+                insert(i);
+            pos += best_length;
+        }
+        else {
+            symbols.push_back({data[pos], 0});
+            ++pos;
+        }
+
+        if (symbols.size() == BLOCK_SYMBOLS && pos < size) {
+            write_block(symbols, false, bits);
+            symbols.clear();
+        }
+    }
+    write_block(symbols, last, bits);
+
+    if (last) {
+        bits.align();
+        return;
+    }
+    // Empty stored block: 3 header bits, padding, then LEN 0 and NLEN.
+    bits.put(0, 3);
+    bits.align();
+    out.insert(out.end(), {0x00, 0x00, 0xff, 0xff});
+}
+
+static constexpr uint32_t ADLER_BASE = 65521;
+
+uint32_t adler32(const uint8_t* data, size_t size, uint32_t adler)
+{
+    uint32_t a = adler & 0xffff;
+    uint32_t b = adler >> 16;
+    while (size > 0) {
+        // Largest run before b can overflow 32 bits.
+        const size_t run = std::min<size_t>(size, 5552);
+        for (size_t i = 0; i < run; ++i) {
+            a += data[i];
+            b += a;
+        }
+        a %= ADLER_BASE;
+        b %= ADLER_BASE;
+        data += run;
+        size -= run;
+    }
+    return (b << 16) | a;
+}
+
+uint32_t adler32_combine(uint32_t adler_a, uint32_t adler_b, size_t size_b)
+{
+    // Same as zlib: a sums carry over, b gains size_b times the a sum of A.
+    const uint32_t rem = static_cast<uint32_t>(size_b % ADLER_BASE);
+    uint32_t sum1 = adler_a & 0xffff;
+    uint32_t sum2 = static_cast<uint32_t>((uint64_t(rem) * sum1) % ADLER_BASE);
+    sum1 += (adler_b & 0xffff) + ADLER_BASE - 1;
+    sum2 += (adler_a >> 16) + (adler_b >> 16) + ADLER_BASE - rem;
+    if (sum1 >= ADLER_BASE)
+        sum1 -= ADLER_BASE;
+    if (sum1 >= ADLER_BASE)
+        sum1 -= ADLER_BASE;
+    if (sum2 >= 2 * ADLER_BASE)
+        sum2 -= 2 * ADLER_BASE;
+    if (sum2 >= ADLER_BASE)
+        sum2 -= ADLER_BASE;
+    return (sum2 << 16) | sum1;
+}
+
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc)
+{
+    struct Table
+    {
+        uint32_t entries[256];
+
+        Table()
+        {
+            for (uint32_t n = 0; n < 256; ++n) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k)
+                    c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                entries[n] = c;
+            }
+        }
+    };
+    static const Table table;
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+        crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Deflate (RFC 1951) compressor for the PNG writer, no zlib needed.
+// LZ77 over hash chains with a 32 KB window, then dynamic Huffman blocks.
+// Each call compresses its data on its own, matches never reach back into
+// earlier calls, so independent pieces of one stream can be compressed in
+// parallel and simply concatenated, the way pigz does.
+
+// Append the compressed data to out. A piece that is not the last ends with
+// an empty stored block, which leaves the stream on a byte boundary for the
+// next piece. The last one ends with the final block.
+void deflate_piece(const uint8_t* data, size_t size, bool last, std::vector<uint8_t>& out);
+
+// Checksums of zlib streams and PNG chunks.
+uint32_t adler32(const uint8_t* data, size_t size, uint32_t adler = 1);
+// Adler-32 of A followed by B, from the checksums of both and the size of B.
+uint32_t adler32_combine(uint32_t adler_a, uint32_t adler_b, size_t size_b);
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0);
@@ -0,0 +1,52 @@
+#include "floatexp.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+bool FloatExp::parse(const std::string& text, FloatExp& value)
+{
+    // Split off the decimal exponent, strtod handles the rest.
+    long exponent10 = 0;
+    std::string mantissa_text = text;
+    const size_t e_pos = text.find_first_of("eE");
+    if (e_pos != std::string::npos) {
+        char* end = nullptr;
+        exponent10 = std::strtol(text.c_str() + e_pos + 1, &end, 10);
+        if (end == text.c_str() + e_pos + 1 || *end != '\0')
+            return false;
+        mantissa_text = text.substr(0, e_pos);
+    }
+
+    char* end = nullptr;
+    const double mantissa = std::strtod(mantissa_text.c_str(), &end);
+    if (mantissa_text.empty() || *end != '\0')
+        return false;
+
+    // 10^e = 2^(e log2 10), split in integer and fractional powers of 2.
+    const double exponent2 = exponent10 * 3.3219280948873623;
+    const double whole = std::floor(exponent2);
+    value = make(mantissa * std::exp2(exponent2 - whole), static_cast<int>(whole));
+    return true;
+}
+
+std::string FloatExp::to_string() const
+{
+    if (mantissa_ == 0.0)
+        return "0";
+
+    // Back to a decimal exponent.
+    const double exponent10 = exponent_ * 0.30102999566398120;
+    const double whole = std::floor(exponent10);
+    // Rounded to the printed digits first, so 9.9999999 carries into the
+    // exponent.
+    double mantissa = std::round(mantissa_ * std::pow(10.0, exponent10 - whole) * 1e5) / 1e5;
+    long e = static_cast<long>(whole);
+    if (std::fabs(mantissa) >= 10.0) {
+        mantissa /= 10.0;
+        ++e;
+    }
+
+    char text[64];
+    std::snprintf(text, sizeof(text), "%.6ge%ld", mantissa, e);
+    return text;
+}
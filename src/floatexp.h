@@ -0,0 +1,254 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FLOATEXP_SSE2
+#endif
+
+// Float with a separate exponent: mantissa * 2^exponent, mantissa in [1, 2).
+// Holds the perturbation deltas and zoom factors past the 1e308 range of
+// double, at double precision.
+// Normalization works on the IEEE bits rather than through frexp().
+class FloatExp
+{
+public:
+    FloatExp() = default;
+    FloatExp(double value) { *this = make(value, 0); }
+
+    // Parse a decimal number such as "1e500" or "-2.5e-1000".
+    static bool parse(const std::string& text, FloatExp& value);
+
+    // value * 2^exponent, normalized.
+    static FloatExp make(double value, int exponent)
+    {
+        uint64_t bits = to_bits(value);
+        const int biased = static_cast<int>((bits >> 52) & 0x7ff);
+        bits = (bits & 0x800fffffffffffffull) | 0x3ff0000000000000ull;
+
+        // Zero (and denormals, never produced by normalized operands) map to
+        // the zero exponent.
+        FloatExp result;
+        result.mantissa_ = biased ? from_bits(bits) : 0.0;
+        result.exponent_ = biased ? exponent + biased - 1023 : ZERO_EXPONENT;
+        return result;
+    }
+
+    double mantissa() const { return mantissa_; }
+    int exponent() const { return exponent_; }
+
+    double to_double() const
+    {
+        if (exponent_ >= -1022 && exponent_ <= 1023)
+            return mantissa_ * pow2(exponent_);
+        return std::ldexp(mantissa_, exponent_);
+    }
+
+    // log2 of the magnitude, -inf for zero.
+    double log2() const
+    {
+        return mantissa_ == 0.0 ? -INFINITY : exponent_ + std::log2(std::fabs(mantissa_));
+    }
+
+    std::string to_string() const;
+
+    FloatExp operator-() const
+    {
+        FloatExp result = *this;
+        result.mantissa_ = -mantissa_;
+        return result;
+    }
+
+    friend FloatExp operator*(const FloatExp& a, const FloatExp& b)
+    {
+        return make(a.mantissa_ * b.mantissa_, a.exponent_ + b.exponent_);
+    }
+
+    friend FloatExp operator/(const FloatExp& a, const FloatExp& b)
+    {
+        return make(a.mantissa_ / b.mantissa_, a.exponent_ - b.exponent_);
+    }
+
+    friend FloatExp operator+(FloatExp a, FloatExp b)
+    {
+        if (a.exponent_ < b.exponent_)
+            std::swap(a, b);
+        return make(a.mantissa_ + b.mantissa_ * scale_down(b.exponent_ - a.exponent_), a.exponent_);
+    }
+
+    friend FloatExp operator-(const FloatExp& a, const FloatExp& b) { return a + (-b); }
+
+    FloatExp& operator+=(const FloatExp& other) { return *this = *this + other; }
+    FloatExp& operator-=(const FloatExp& other) { return *this = *this - other; }
+    FloatExp& operator*=(const FloatExp& other) { return *this = *this * other; }
+    FloatExp& operator/=(const FloatExp& other) { return *this = *this / other; }
+
+    friend bool operator<(const FloatExp& a, const FloatExp& b) { return (a - b).mantissa_ < 0.0; }
+    friend bool operator>(const FloatExp& a, const FloatExp& b) { return b < a; }
+    friend bool operator<=(const FloatExp& a, const FloatExp& b) { return !(b < a); }
+    friend bool operator>=(const FloatExp& a, const FloatExp& b) { return !(a < b); }
+
+    friend FloatExp abs(const FloatExp& a)
+    {
+        FloatExp result = a;
+        result.mantissa_ = std::fabs(a.mantissa_);
+        return result;
+    }
+
+    friend FloatExp sqrt(const FloatExp& a)
+    {
+        // Keep the exponent even so it halves exactly.
+        const int odd = a.exponent_ & 1;
+        return make(std::sqrt(a.mantissa_ * (odd ? 2.0 : 1.0)), (a.exponent_ - odd) / 2);
+    }
+
+private:
+    friend class ComplexFloatExp;
+
+    // Far enough below any real exponent that adding exponents of two zeros
+    // cannot overflow.
+    static constexpr int ZERO_EXPONENT = -(1 << 29);
+
+    static uint64_t to_bits(double value)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    static double from_bits(uint64_t bits)
+    {
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // 2^e for e in the normal double range.
+    static double pow2(int e) { return from_bits(static_cast<uint64_t>(e + 1023) << 52); }
+
+    // 2^e for e <= 0, 0 when it underflows.
+    static double scale_down(int e) { return e >= -1022 ? pow2(e) : 0.0; }
+
+    double mantissa_ = 0.0;
+    int exponent_ = ZERO_EXPONENT;
+};
+
+// Conversions for code templated over double and FloatExp.
+inline double to_double(double value) { return value; }
+inline double to_double(const FloatExp& value) { return value.to_double(); }
+
+// Complex number past the range of double: (x + i y) 2^exponent, with one
+// exponent for both parts, the perturbation deltas of the deepest views. The
+// parts sit in the two lanes of an SSE2 register: a product is one complex
+// multiply of the mantissas and a sum aligns one exponent rather than two,
+// without the branches of FloatExp::operator+. Sums and products leave the
+// mantissas a few bits off [1, 2), normalize() rescales both lanes at once,
+// once per iteration of the caller rather than after every operation. The
+// smaller part keeps the absolute precision of the larger one, which is what
+// perturbation needs.
+class ComplexFloatExp
+{
+public:
+    ComplexFloatExp() = default;
+    ComplexFloatExp(double x, double y) : mantissa_(make(x, y)), exponent_(0) { normalize(); }
+    ComplexFloatExp(const FloatExp& x, const FloatExp& y)
+        : exponent_(std::max(x.exponent_, y.exponent_))
+    {
+        mantissa_ = make(x.mantissa_ * scale_down(x.exponent_ - exponent_),
+                         y.mantissa_ * scale_down(y.exponent_ - exponent_));
+    }
+
+    // Both parts rounded to double, 0 where they underflow.
+    void to_double(double& x, double& y) const
+    {
+        const double scale = exponent_ > 1023 ? INFINITY : scale_down(exponent_);
+        x = part(0) * scale;
+        y = part(1) * scale;
+    }
+
+    // |z|^2 = x^2 + y^2
+    FloatExp norm() const
+    {
+        return FloatExp::make(part(0) * part(0) + part(1) * part(1), 2 * exponent_);
+    }
+
+    friend ComplexFloatExp operator+(const ComplexFloatExp& a, const ComplexFloatExp& b)
+    {
+        ComplexFloatExp result;
+        result.exponent_ = std::max(a.exponent_, b.exponent_);
+        result.mantissa_ = add(scale(a.mantissa_, scale_down(a.exponent_ - result.exponent_)),
+                               scale(b.mantissa_, scale_down(b.exponent_ - result.exponent_)));
+        return result;
+    }
+
+    // (ax bx - ay by, ax by + ay bx)
+    friend ComplexFloatExp operator*(const ComplexFloatExp& a, const ComplexFloatExp& b)
+    {
+        ComplexFloatExp result;
+        result.exponent_ = a.exponent_ + b.exponent_;
+        result.mantissa_ = multiply(a.mantissa_, b.mantissa_);
+        return result;
+    }
+
+    // Largest part to [1, 2), zero to FloatExp's zero exponent so it drops
+    // out of sums.
+    void normalize()
+    {
+        const double largest = std::max(std::fabs(part(0)), std::fabs(part(1)));
+        const int biased = static_cast<int>((FloatExp::to_bits(largest) >> 52) & 0x7ff);
+        if (biased == 0) {
+            *this = ComplexFloatExp();
+            return;
+        }
+        mantissa_ = scale(mantissa_, FloatExp::from_bits(static_cast<uint64_t>(2046 - biased) << 52));
+        exponent_ += biased - 1023;
+    }
+
+private:
+    static double scale_down(int e) { return FloatExp::scale_down(e); }
+
+#if defined(FLOATEXP_SSE2)
+    using Mantissa = __m128d;
+
+    static Mantissa make(double x, double y) { return _mm_set_pd(y, x); }
+    static Mantissa add(Mantissa a, Mantissa b) { return _mm_add_pd(a, b); }
+    static Mantissa scale(Mantissa a, double s) { return _mm_mul_pd(a, _mm_set1_pd(s)); }
+    double part(int k) const
+    {
+        return _mm_cvtsd_f64(k ? _mm_unpackhi_pd(mantissa_, mantissa_) : mantissa_);
+    }
+
+    static Mantissa multiply(Mantissa a, Mantissa b)
+    {
+        // (ax bx, ax by) + (-ay by, ay bx)
+        const Mantissa swapped = _mm_shuffle_pd(b, b, 1);
+        const Mantissa left = _mm_mul_pd(_mm_unpacklo_pd(a, a), b);
+        const Mantissa right = _mm_mul_pd(_mm_unpackhi_pd(a, a), swapped);
+        return _mm_add_pd(left, _mm_xor_pd(right, _mm_set_pd(0.0, -0.0)));
+    }
+#else
+    struct Mantissa
+    {
+        double x, y;
+    };
+
+    static Mantissa make(double x, double y) { return {x, y}; }
+    static Mantissa add(Mantissa a, Mantissa b) { return {a.x + b.x, a.y + b.y}; }
+    static Mantissa scale(Mantissa a, double s) { return {a.x * s, a.y * s}; }
+    double part(int k) const { return k ? mantissa_.y : mantissa_.x; }
+
+    static Mantissa multiply(Mantissa a, Mantissa b)
+    {
+        return {a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x};
+    }
+#endif
+
+    Mantissa mantissa_ = make(0.0, 0.0);
+    int exponent_ = FloatExp::ZERO_EXPONENT;
+};
@@ -0,0 +1,331 @@
+#include "fractal.h"
+
+#include "kernel.h"
+#include "perturbation.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+// Same palette as frag.glsl.
+static const float C1[3] = {0.4f, 0.0f, 0.0f};
+static const float C2[3] = {1.0f, 1.0f, 0.0f};
+
+// Whether a few steps of a floating point type of the given epsilon fit in
+// one pixel of view.
+static bool resolves_pixels(const View& view, double epsilon)
+{
+    // Spacing of pixels in C, same on both axes.
+    const double pixel = 2.0 / (view.height * view.zoom.to_double());
+    const double magnitude = std::fmax(std::fmax(std::fabs(view.center[0].to_double()),
+                                                 std::fabs(view.center[1].to_double())), 1.0);
+
+    // Below a few steps per pixel the image turns blocky.
+    return pixel >= 4.0 * magnitude * epsilon;
+}
+
+bool needs_double(const View& view)
+{
+    return !resolves_pixels(view, std::numeric_limits<float>::epsilon());
+}
+
+bool needs_perturbation(const View& view)
+{
+    return !resolves_pixels(view, std::numeric_limits<double>::epsilon());
+}
+
+// Screen position of pixel (x, y), from -1 to 1 vertically.
+static void screen_position(const View& view, int x, int y, float& px, float& py)
+{
+    const float width = static_cast<float>(view.width);
+    const float height = static_cast<float>(view.height);
+    const float ratio = width / height;
+
+    // gl_FragCoord points to the pixel center. Screen position is in float
+    // in every shader, only the offset in C uses a wider type.
+    px = 2.0f * ((static_cast<float>(x) + 0.5f) / width) - 1.0f;
+    py = 2.0f * ((static_cast<float>(y) + 0.5f) / height) - 1.0f;
+    px *= ratio;
+}
+
+template <typename T>
+static void to_plane(const View& view, int x, int y, T& cx, T& cy)
+{
+    float px, py;
+    screen_position(view, x, y, px, py);
+
+    // Uniforms are set with the precision of T.
+    const T zoom = static_cast<T>(view.zoom.to_double());
+    cx = static_cast<T>(view.center[0].to_double()) + static_cast<T>(px) / zoom;
+    cy = static_cast<T>(view.center[1].to_double()) + static_cast<T>(py) / zoom;
+}
+
+void pixel_to_offset(const View& view, int x, int y, double& dx, double& dy)
+{
+    float px, py;
+    screen_position(view, x, y, px, py);
+    dx = static_cast<double>(px) / view.zoom.to_double();
+    dy = static_cast<double>(py) / view.zoom.to_double();
+}
+
+void pixel_to_offset(const View& view, int x, int y, FloatExp& dx, FloatExp& dy)
+{
+    float px, py;
+    screen_position(view, x, y, px, py);
+    dx = FloatExp(px) / view.zoom;
+    dy = FloatExp(py) / view.zoom;
+}
+
+void pixel_to_plane(const View& view, int x, int y, float& cx, float& cy)
+{
+    to_plane(view, x, y, cx, cy);
+}
+
+void pixel_to_plane(const View& view, int x, int y, double& cx, double& cy)
+{
+    to_plane(view, x, y, cx, cy);
+}
+
+int mandelbrot(float cx, float cy, int max_iter)
+{
+    if (in_main_bulbs(cx, cy))
+        return max_iter;
+    return escape_time<Formula::Mandelbrot>(cx, cy, max_iter).iter;
+}
+
+int mandelbrot(double cx, double cy, int max_iter)
+{
+    if (in_main_bulbs(cx, cy))
+        return max_iter;
+    return escape_time<Formula::Mandelbrot>(cx, cy, max_iter).iter;
+}
+
+// Real part of each column, it does not depend on the row.
+template <typename T>
+static std::vector<T> column_coords(const View& view, const float* offset)
+{
+    std::vector<T> cx(view.width);
+    for (int x = 0; x < view.width; ++x) {
+        T unused;
+        pixel_to_plane(view, x, 0, cx[x], unused);
+    }
+    if (offset) {
+        const T pixel = static_cast<T>(2.0 / (view.height * view.zoom.to_double()));
+        for (int x = 0; x < view.width; ++x)
+            cx[x] += static_cast<T>(offset[x]) * pixel;
+    }
+    return cx;
+}
+
+// Imaginary part of rows [y0, y0 + rows).
+template <typename T>
+static std::vector<T> row_coords(const View& view, int y0, int rows, const float* offset)
+{
+    std::vector<T> cy(rows);
+    for (int y = 0; y < rows; ++y) {
+        T unused;
+        pixel_to_plane(view, 0, y0 + y, unused, cy[y]);
+    }
+    if (offset) {
+        const T pixel = static_cast<T>(2.0 / (view.height * view.zoom.to_double()));
+        for (int y = 0; y < rows; ++y)
+            cy[y] += static_cast<T>(offset[y]) * pixel;
+    }
+    return cy;
+}
+
+// Returns the number of pixels skipped as interior.
+template <typename T, typename Kernel>
+static long long render_tile(const View& view, const std::vector<T>& cx, const std::vector<T>& cy,
+                             Kernel kernel, const Tile& tile, IterBuffer& iters)
+{
+    long long skipped = 0;
+    for (int y = tile.y0; y < tile.y0 + tile.height; ++y) {
+        skipped += kernel(&cx[tile.x0], cy[y], tile.width, view.max_iter,
+                          &iters.iter[static_cast<size_t>(y) * view.width + tile.x0]);
+    }
+    return skipped;
+}
+
+// Render tiles of rows [y0, y0 + rows) through the scheduler in the
+// precision of T. Brute force goes a row at a time through kernel, other
+// strategies and pixels seeded through options.keep ask for batches of
+// pixels anywhere in the tile, which go to point_kernel.
+template <typename T, typename Kernel, typename PointKernel>
+static void render_tiles(const View& view, int y0, int rows, Kernel kernel, PointKernel point_kernel,
+                         const RenderOptions& options, IterBuffer& iters, SchedulerStats* stats,
+                         RenderStats* render_stats)
+{
+    const std::vector<T> cx = column_coords<T>(view, options.column_offset);
+    const std::vector<T> cy = row_coords<T>(view, y0, rows, options.row_offset);
+    std::atomic<long long> skipped(0);
+    std::atomic<long long> computed(0);
+    run_tiles(view.width, rows, options.tile_size, options.threads,
+              [&](const Tile& tile) {
+                  if (options.strategy == Strategy::BruteForce && !options.keep) {
+                      skipped += render_tile(view, cx, cy, kernel, tile, iters);
+                      computed += static_cast<long long>(tile.width) * tile.height;
+                      return;
+                  }
+
+                  long long tile_skipped = 0;
+                  std::vector<T> packed_cx;
+                  std::vector<T> packed_cy;
+                  const PixelKernel pixels = [&](const int* x, const int* y, int count, int* iter) {
+                      packed_cx.resize(count);
+                      packed_cy.resize(count);
+                      for (int i = 0; i < count; ++i) {
+                          packed_cx[i] = cx[x[i]];
+                          packed_cy[i] = cy[y[i]];
+                      }
+                      tile_skipped +=
+                          point_kernel(packed_cx.data(), packed_cy.data(), count, view.max_iter, iter);
+                  };
+                  computed += fill_tile(options.strategy, tile, view.width, pixels, iters.iter.data(),
+                                        options.keep);
+                  skipped += tile_skipped;
+              },
+              stats);
+
+    if (render_stats) {
+        render_stats->pixels = static_cast<long long>(view.width) * rows;
+        render_stats->computed = computed;
+        render_stats->interior_skipped = skipped;
+    }
+}
+
+static void resize_iterations(const View& view, int rows, IterBuffer& iters)
+{
+    iters.width = view.width;
+    iters.height = rows;
+    iters.iter.resize(static_cast<size_t>(view.width) * rows);
+}
+
+void render_iterations(const View& view, IterBuffer& iters, Isa isa)
+{
+    resize_iterations(view, view.height, iters);
+
+    if (needs_perturbation(view)) {
+        RenderOptions options;
+        options.isa = isa;
+        options.threads = 1;
+        render_perturbation(view, iters, options);
+        return;
+    }
+
+    Tile whole;
+    whole.width = view.width;
+    whole.height = view.height;
+    if (needs_double(view))
+        render_tile(view, column_coords<double>(view, nullptr),
+                    row_coords<double>(view, 0, view.height, nullptr), row_kernel_f64(isa), whole, iters);
+    else
+        render_tile(view, column_coords<float>(view, nullptr),
+                    row_coords<float>(view, 0, view.height, nullptr), row_kernel(isa), whole, iters);
+}
+
+void render_iterations(const View& view, IterBuffer& iters, const RenderOptions& options,
+                       SchedulerStats* stats, RenderStats* render_stats)
+{
+    render_rows(view, 0, view.height, iters, options, stats, render_stats);
+}
+
+void render_rows(const View& view, int y0, int rows, IterBuffer& iters,
+                 const RenderOptions& options, SchedulerStats* stats, RenderStats* render_stats)
+{
+    if (needs_perturbation(view)) {
+        PerturbationReference reference;
+        prepare_reference(view, options, reference);
+        render_perturbation_rows(view, reference, y0, rows, iters, options, stats, nullptr,
+                                 render_stats);
+        return;
+    }
+
+    resize_iterations(view, rows, iters);
+
+    if (needs_double(view))
+        render_tiles<double>(view, y0, rows, row_kernel_f64(options.isa), point_kernel_f64(options.isa),
+                             options, iters, stats, render_stats);
+    else
+        render_tiles<float>(view, y0, rows, row_kernel(options.isa), point_kernel(options.isa),
+                            options, iters, stats, render_stats);
+}
+
+// Float to 8-bit unorm conversion done by GL when writing the framebuffer.
+static unsigned char to_unorm8(float value)
+{
+    value = std::fmin(std::fmax(value, 0.0f), 1.0f);
+    return static_cast<unsigned char>(std::lround(value * 255.0f));
+}
+
+void colorize(const IterBuffer& iters, int max_iter, Image& image, int palette)
+{
+    image.width = iters.width;
+    image.height = iters.height;
+    image.rgb.resize(iters.iter.size() * 3);
+    colorize_rows(iters, max_iter, 0, iters.height, image.rgb.data(), palette);
+}
+
+// Cosine gradient of colorize.glsl, one cycle when t goes through 1.
+static float cosine_palette(float t, float phase)
+{
+    return 0.5f + 0.5f * std::cos(6.2831853f * (t + phase));
+}
+
+void colorize_rows(const IterBuffer& iters, int max_iter, int y0, int rows, unsigned char* rgb,
+                   int palette)
+{
+    const size_t first = static_cast<size_t>(y0) * iters.width;
+    const size_t count = static_cast<size_t>(rows) * iters.width;
+
+    // Color of each iteration count, black for points in the set. Looked up
+    // when there are fewer counts than pixels, which is the usual case.
+    auto color = [max_iter, palette](int n, unsigned char* pixel) {
+        if (n >= max_iter) {
+            pixel[0] = pixel[1] = pixel[2] = 0;
+            return;
+        }
+        static const float PHASE[3] = {0.0f, 0.1f, 0.2f};
+        const float t = static_cast<float>(n) / max_iter;
+        for (int k = 0; k < 3; ++k) {
+            if (palette == 1)
+                pixel[k] = to_unorm8(cosine_palette(n / 64.0f, PHASE[k]));
+            else if (palette == 2)
+                pixel[k] = to_unorm8(cosine_palette(n / 32.0f, 0.0f));
+            else
+                pixel[k] = to_unorm8((1.0f - t) * C1[k] + t * C2[k]);
+        }
+    };
+    if (static_cast<size_t>(max_iter) > count) {
+        for (size_t i = 0; i < count; ++i)
+            color(iters.iter[first + i], &rgb[i * 3]);
+        return;
+    }
+
+    std::vector<unsigned char> colors(static_cast<size_t>(max_iter + 1) * 3);
+    for (int n = 0; n <= max_iter; ++n)
+        color(n, &colors[n * 3]);
+    for (size_t i = 0; i < count; ++i) {
+        const int n = std::min(std::max(iters.iter[first + i], 0), max_iter);
+        std::copy(&colors[n * 3], &colors[n * 3] + 3, &rgb[i * 3]);
+    }
+}
+
+void render_image(const View& view, Image& image,
+                  const RenderOptions& options, SchedulerStats* stats)
+{
+    IterBuffer iters;
+    render_iterations(view, iters, options, stats);
+    colorize(iters, view.max_iter, image);
+}
+
+long long escaped_iterations(const IterBuffer& iters, int max_iter)
+{
+    long long total = 0;
+    for (int n : iters.iter) {
+        if (n < max_iter)
+            total += n + 1;
+    }
+    return total;
+}
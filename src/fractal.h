@@ -0,0 +1,128 @@
+#pragma once
+
+#include <vector>
+
+#include "bigfixed.h"
+#include "floatexp.h"
+#include "scheduler.h"
+#include "simd.h"
+#include "strategy.h"
+
+// CPU port of the escape-time renderer in frag.glsl.
+// Produces the same pixels as the shader so both outputs can be compared.
+
+// View parameters, same meaning as the u_zoom/u_center/u_width/u_height
+// uniforms fed from the Input struct.
+// Iteration switches from float to double past the zoom where float pixels
+// collapse, like zoom does with frag64.glsl, then to perturbation around the
+// center which is kept in arbitrary precision. Zoom is past the range of
+// double from 1e308 on.
+struct View
+{
+    FloatExp zoom = 1.0;
+    BigFixed center[2] = {0.0, 0.0};
+    int width = 100;
+    int height = 100;
+    int max_iter = 200;
+};
+
+// Escape iteration of each pixel, max_iter for points considered in the set.
+// Rows are stored bottom to top, like gl_FragCoord and glReadPixels.
+struct IterBuffer
+{
+    int width = 0;
+    int height = 0;
+    std::vector<int> iter;
+};
+
+// 8-bit RGB image, same row order as IterBuffer.
+struct Image
+{
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> rgb;
+};
+
+// How the CPU engine spreads the work.
+struct RenderOptions
+{
+    Isa isa = best_isa();
+    int threads = 0; // 0 for one per hardware thread
+    int tile_size = 64;
+    bool bla = true; // skip perturbation iterations with a BLA table
+    Strategy strategy = Strategy::BruteForce;
+    // Pixels of the rows rendered, laid out like IterBuffer::iter, whose
+    // value is already in the buffer and only computed again if not set.
+    // Animation frames seeded from the frame before set it.
+    const unsigned char* keep = nullptr;
+    // Where each column and each of the rows rendered is sampled, as an
+    // offset of at most one pixel from its center. Centers if not set.
+    const float* column_offset = nullptr;
+    const float* row_offset = nullptr;
+};
+
+// What the kernels did with the pixels of a render.
+struct RenderStats
+{
+    long long pixels = 0;
+    long long computed = 0;         // the rest were inferred by the strategy
+    long long interior_skipped = 0; // in the main cardioid or period-2 bulb
+
+    double computed_fraction() const { return pixels ? double(computed) / pixels : 0.0; }
+};
+
+// Whether neighbouring pixels of view are too close to be told apart in
+// float, or in double.
+bool needs_double(const View& view);
+bool needs_perturbation(const View& view);
+
+// Locate the point in C of pixel (x, y), as main() in frag.glsl and
+// frag64.glsl do.
+void pixel_to_plane(const View& view, int x, int y, float& cx, float& cy);
+void pixel_to_plane(const View& view, int x, int y, double& cx, double& cy);
+
+// Offset in C of pixel (x, y) from the view center. Offsets underflow double
+// past a zoom of 1e308, FloatExp holds them at any zoom.
+void pixel_to_offset(const View& view, int x, int y, double& dx, double& dy);
+void pixel_to_offset(const View& view, int x, int y, FloatExp& dx, FloatExp& dy);
+
+// Escape iteration of point c, max_iter if it does not escape. Points of the
+// main cardioid and period-2 bulb return max_iter without iterating.
+int mandelbrot(float cx, float cy, int max_iter);
+int mandelbrot(double cx, double cy, int max_iter);
+
+// Render on the calling thread with the kernel of isa, in float or double
+// as needs_double() tells, or by perturbation when even double is not enough.
+void render_iterations(const View& view, IterBuffer& iters, Isa isa);
+
+// Render on all threads through the tile scheduler.
+void render_iterations(const View& view, IterBuffer& iters,
+                       const RenderOptions& options = RenderOptions(),
+                       SchedulerStats* stats = nullptr,
+                       RenderStats* render_stats = nullptr);
+
+// Rows [y0, y0 + rows) of view only, into iters of view.width x rows: the
+// same pixels as those rows of render_iterations(), for images too large to
+// hold at once. Views past double compute a reference orbit on every call,
+// render_perturbation_rows() shares one between calls.
+void render_rows(const View& view, int y0, int rows, IterBuffer& iters,
+                 const RenderOptions& options = RenderOptions(),
+                 SchedulerStats* stats = nullptr,
+                 RenderStats* render_stats = nullptr);
+
+// Palettes of colorize.glsl, on whole iteration counts at exposure 1.
+constexpr int PALETTE_COUNT = 3;
+
+void colorize(const IterBuffer& iters, int max_iter, Image& image, int palette = 0);
+// Colors of rows [y0, y0 + rows) of iters only, into rgb.
+void colorize_rows(const IterBuffer& iters, int max_iter, int y0, int rows, unsigned char* rgb,
+                   int palette = 0);
+void render_image(const View& view, Image& image,
+                  const RenderOptions& options = RenderOptions(),
+                  SchedulerStats* stats = nullptr);
+
+// Number of iterations of the pixels of iters that escaped, used for
+// throughput reports. Interior pixels are left out: points of the main
+// cardioid and period-2 bulb are not iterated and the others stop once
+// caught in a cycle, their work cannot be told from max_iter.
+long long escaped_iterations(const IterBuffer& iters, int max_iter);
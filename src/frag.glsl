@@ -1,15 +1,32 @@
 #version 400 core
 
-out vec4 frag_color;
+// Escape iteration and smooth iteration count of the pixel, u_max_iter for
+// both inside the set, then 0 for the error of an exact pixel. Colored by
+// colorize.glsl.
+out vec4 frag_iter;
 
 uniform float u_zoom;
 uniform vec2 u_center;
 uniform float u_width;
 uniform float u_height;
+uniform int u_max_iter;
 
-vec3 C1 = vec3(0.4, 0.0, 0.0);
-vec3 C2 = vec3(1.0, 1.0, 0.0);
-int MAX_ITER = 200;
+// Progressive refinement: only pixels on the u_step grid are iterated,
+// minus those on the u_prev_step grid that an earlier pass already did.
+// (1, 1) and (0, 0) iterate every pixel.
+uniform ivec2 u_step;
+uniform ivec2 u_prev_step;
+
+// Zoom refinement: u_estimate holds pixels reprojected from the last frame
+// (see reproject.glsl), with how many pixels off each may be in z. Those at
+// most u_keep_error off are copied, the others iterated. -1 iterates all.
+uniform sampler2D u_estimate;
+uniform float u_keep_error;
+
+bool on_grid(ivec2 pixel, ivec2 step)
+{
+    return step.x > 0 && pixel.x % step.x == 0 && pixel.y % step.y == 0;
+}
 
 // Complex multiplication
 vec2 cmul(vec2 a, vec2 b)
@@ -18,28 +35,84 @@ vec2 cmul(vec2 a, vec2 b)
                 a.x * b.y + a.y * b.x);
 }
 
-// Compute fractal pixel color
+// Squared distance under which an orbit is back on a point it visited,
+// (16 epsilon)^2 of float like cycle_tolerance2() on the CPU.
+const float CYCLE_TOLERANCE2 = 3.6379788e-12;
+
+// Whether p is in the main cardioid or the period-2 bulb, where orbits
+// never escape, same test as in_main_bulbs() on the CPU.
+bool in_main_bulbs(vec2 p)
+{
+    float y2 = p.y * p.y;
+    float x = p.x - 0.25;
+    float q = x * x + y2;
+    if (q * (q + x) <= 0.25 * y2)
+        return true;
+
+    float x1 = p.x + 1.0;
+    return x1 * x1 + y2 <= 0.0625;
+}
+
+// Smooth iteration count of a point that escaped at step i: a few more
+// steps take z far enough for n - log2(log2|z|) to be continuous, like
+// escape_outputs() on the CPU.
+float smooth_iteration(vec2 z, vec2 p, int i)
+{
+    int n = i;
+    for (int extra = 0; extra < 8 && dot(z, z) <= 65536.0; ++extra) {
+        z = cmul(z, z) + p;
+        ++n;
+    }
+    return float(n) - log2(0.5 * log2(float(dot(z, z))));
+}
+
+// Escape iteration and smooth iteration count
 // Input: position in C plane
-vec3 mandelbrot(vec2 p)
+vec2 mandelbrot(vec2 p)
 {
+    if (in_main_bulbs(p))
+        return vec2(u_max_iter);
+
     vec2 z_n = p;
-    for (int i = 0; i < MAX_ITER; ++i) {
+
+    // Brent cycle detection against a point saved at steps 1, 2, 4, 8...
+    vec2 saved = z_n;
+    int save_at = 1;
+    for (int i = 0; i < u_max_iter; ++i) {
         // Zn+1 = Zn^2 + C
         z_n = cmul(z_n, z_n) + p;
 
         // Stop condition: radius > 2 guaranteed does not belong to the set
-        if (length(z_n) > 2) {
-            float t = float(i) / MAX_ITER;
-            return (1.0-t) * C1 + t * C2;
+        if (dot(z_n, z_n) > 4.0)
+            return vec2(float(i), smooth_iteration(z_n, p, i));
+
+        vec2 e = z_n - saved;
+        if (dot(e, e) < CYCLE_TOLERANCE2)
+            break;
+        if (i == save_at) {
+            saved = z_n;
+            save_at *= 2;
         }
     }
 
     // If reaches here, the point is considered in the set
-    return vec3(0.0);
+    return vec2(u_max_iter);
 }
 
 void main()
 {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    if (!on_grid(pixel, u_step) || on_grid(pixel, u_prev_step))
+        discard;
+
+    if (u_keep_error >= 0.0) {
+        vec4 estimate = texelFetch(u_estimate, pixel, 0);
+        if (estimate.z <= u_keep_error) {
+            frag_iter = estimate;
+            return;
+        }
+    }
+
     float ratio = u_width / u_height;
     vec2 p_ = gl_FragCoord.xy / vec2(u_width, u_height);
     vec2 p = 2.0*p_ - vec2(1.0);
@@ -48,5 +121,5 @@ void main()
     // Locate corresponding point in C^2
     vec2 c = u_center + p / u_zoom;
 
-    frag_color = vec4(mandelbrot(c), 1.0);
+    frag_iter = vec4(mandelbrot(c), 0.0, 0.0);
 }
@@ -0,0 +1,124 @@
+#version 400 core
+#extension GL_ARB_gpu_shader_fp64 : enable
+
+// Double precision variant of frag.glsl, used once the zoom is past what
+// float can resolve.
+
+// Escape iteration, smooth iteration count and error, as in frag.glsl.
+out vec4 frag_iter;
+
+uniform double u_zoom;
+uniform dvec2 u_center;
+uniform float u_width;
+uniform float u_height;
+uniform int u_max_iter;
+
+// Pixels iterated by this refinement pass, as in frag.glsl.
+uniform ivec2 u_step;
+uniform ivec2 u_prev_step;
+
+// Reprojected pixels kept as they are, as in frag.glsl.
+uniform sampler2D u_estimate;
+uniform float u_keep_error;
+
+bool on_grid(ivec2 pixel, ivec2 step)
+{
+    return step.x > 0 && pixel.x % step.x == 0 && pixel.y % step.y == 0;
+}
+
+// Complex multiplication
+dvec2 cmul(dvec2 a, dvec2 b)
+{
+    return dvec2(a.x * b.x - a.y * b.y,
+                 a.x * b.y + a.y * b.x);
+}
+
+// Squared distance under which an orbit is back on a point it visited,
+// (16 epsilon)^2 of double like cycle_tolerance2() on the CPU.
+const double CYCLE_TOLERANCE2 = 1.2621774483536189e-29LF;
+
+// Whether p is in the main cardioid or the period-2 bulb, where orbits
+// never escape, same test as in_main_bulbs() on the CPU.
+bool in_main_bulbs(dvec2 p)
+{
+    double y2 = p.y * p.y;
+    double x = p.x - 0.25;
+    double q = x * x + y2;
+    if (q * (q + x) <= 0.25 * y2)
+        return true;
+
+    double x1 = p.x + 1.0;
+    return x1 * x1 + y2 <= 0.0625;
+}
+
+// Smooth iteration count of a point that escaped at step i: a few more
+// steps take z far enough for n - log2(log2|z|) to be continuous, like
+// escape_outputs() on the CPU.
+float smooth_iteration(dvec2 z, dvec2 p, int i)
+{
+    int n = i;
+    for (int extra = 0; extra < 8 && dot(z, z) <= 65536.0; ++extra) {
+        z = cmul(z, z) + p;
+        ++n;
+    }
+    return float(n) - log2(0.5 * log2(float(dot(z, z))));
+}
+
+// Escape iteration and smooth iteration count
+// Input: position in C plane
+vec2 mandelbrot(dvec2 p)
+{
+    if (in_main_bulbs(p))
+        return vec2(u_max_iter);
+
+    dvec2 z_n = p;
+
+    // Brent cycle detection against a point saved at steps 1, 2, 4, 8...
+    dvec2 saved = z_n;
+    int save_at = 1;
+    for (int i = 0; i < u_max_iter; ++i) {
+        // Zn+1 = Zn^2 + C
+        z_n = cmul(z_n, z_n) + p;
+
+        // Stop condition: radius > 2 guaranteed does not belong to the set
+        if (dot(z_n, z_n) > 4.0)
+            return vec2(float(i), smooth_iteration(z_n, p, i));
+
+        dvec2 e = z_n - saved;
+        if (dot(e, e) < CYCLE_TOLERANCE2)
+            break;
+        if (i == save_at) {
+            saved = z_n;
+            save_at *= 2;
+        }
+    }
+
+    // If reaches here, the point is considered in the set
+    return vec2(u_max_iter);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    if (!on_grid(pixel, u_step) || on_grid(pixel, u_prev_step))
+        discard;
+
+    if (u_keep_error >= 0.0) {
+        vec4 estimate = texelFetch(u_estimate, pixel, 0);
+        if (estimate.z <= u_keep_error) {
+            frag_iter = estimate;
+            return;
+        }
+    }
+
+    float ratio = u_width / u_height;
+    vec2 p_ = gl_FragCoord.xy / vec2(u_width, u_height);
+    vec2 p = 2.0*p_ - vec2(1.0);
+    p.x *= ratio;
+
+    // Locate corresponding point in C^2, the offset from the center is
+    // small enough for float but not the sum.
+    dvec2 c = u_center + dvec2(p) / u_zoom;
+
+    frag_iter = vec4(mandelbrot(c), 0.0, 0.0);
+}
@@ -0,0 +1,171 @@
+#version 400 core
+
+// Perturbation variant of frag.glsl for zooms past double precision.
+// The reference orbit Z is computed on the CPU and read from u_orbit, each
+// pixel only iterates its offset dz from it:
+//     dz_n+1 = (2 Z_n + dz_n) dz_n + dc
+// When Z + dz gets smaller than dz, or the reference ends, the pixel is
+// rebased onto the start of the orbit.
+// Runs of iterations where dz stays small are skipped with the bilinear
+// approximation table u_bla (see bla.h).
+
+// Escape iteration, smooth iteration count and error, as in frag.glsl.
+out vec4 frag_iter;
+
+uniform double u_zoom;
+uniform dvec2 u_offset; // view center - reference point
+uniform float u_width;
+uniform float u_height;
+uniform int u_max_iter;
+
+// Pixels iterated by this refinement pass, as in frag.glsl.
+uniform ivec2 u_step;
+uniform ivec2 u_prev_step;
+
+// Reprojected pixels kept as they are, as in frag.glsl.
+uniform sampler2D u_estimate;
+uniform float u_keep_error;
+
+bool on_grid(ivec2 pixel, ivec2 step)
+{
+    return step.x > 0 && pixel.x % step.x == 0 && pixel.y % step.y == 0;
+}
+
+// Z_n as (x_lo, x_hi, y_lo, y_hi) halves of doubles.
+uniform usamplerBuffer u_orbit;
+uniform int u_orbit_length;
+
+// BLA steps of levels 1 and up, 3 texels each: A, B, (r^2, length).
+uniform usamplerBuffer u_bla;
+uniform int u_bla_levels; // 0 disables BLA
+uniform int u_bla_offset[32];
+uniform int u_bla_count[32];
+
+double texel_double(usamplerBuffer buffer, int texel, int part)
+{
+    uvec4 t = texelFetch(buffer, texel);
+    return packDouble2x32(part == 0 ? t.xy : t.zw);
+}
+
+dvec2 texel_complex(usamplerBuffer buffer, int texel)
+{
+    uvec4 t = texelFetch(buffer, texel);
+    return dvec2(packDouble2x32(t.xy), packDouble2x32(t.zw));
+}
+
+dvec2 reference(int n)
+{
+    return texel_complex(u_orbit, n);
+}
+
+// Longest BLA step starting at reference index m, valid for |dz|^2 = dz2
+// and at most max_length iterations long. -1 if there is none.
+int bla_lookup(int m, double dz2, int max_length)
+{
+    int p = m - 1;
+    if (p < 0)
+        return -1;
+
+    // Steps of level k only start at multiples of 2^k.
+    int top = u_bla_levels - 1;
+    if (p > 0)
+        top = min(top, findLSB(p));
+
+    // A merged step is never valid further than its first half.
+    int best = -1;
+    for (int k = 1; k <= top; ++k) {
+        int j = p >> k;
+        if (j >= u_bla_count[k] || (1 << k) > max_length)
+            break;
+        int step = u_bla_offset[k] + j;
+        if (dz2 >= texel_double(u_bla, 3 * step + 2, 0))
+            break;
+        best = step;
+    }
+    return best;
+}
+
+// Complex multiplication
+dvec2 cmul(dvec2 a, dvec2 b)
+{
+    return dvec2(a.x * b.x - a.y * b.y,
+                 a.x * b.y + a.y * b.x);
+}
+
+// Smooth iteration count of a point that escaped at step i, see frag.glsl.
+// Past radius 2 precision no longer matters, z is iterated directly.
+float smooth_iteration(dvec2 z, dvec2 c, int i)
+{
+    int n = i;
+    for (int extra = 0; extra < 8 && dot(z, z) <= 65536.0; ++extra) {
+        z = cmul(z, z) + c;
+        ++n;
+    }
+    return float(n) - log2(0.5 * log2(float(dot(z, z))));
+}
+
+// Escape iteration and smooth iteration count
+// Input: offset of the pixel from the reference point
+vec2 mandelbrot(dvec2 dc)
+{
+    dvec2 dz = dc;
+    int m = 1;
+    int i = 0;
+    while (i < u_max_iter) {
+        int step = bla_lookup(m, dot(dz, dz), u_max_iter - i);
+        if (step >= 0) {
+            // dz = A dz + B dc
+            dz = cmul(texel_complex(u_bla, 3 * step), dz) +
+                 cmul(texel_complex(u_bla, 3 * step + 1), dc);
+            int length = int(texel_double(u_bla, 3 * step + 2, 1));
+            m += length;
+            i += length;
+        }
+        else {
+            dz = cmul(2.0 * reference(m) + dz, dz) + dc;
+            ++m;
+            ++i;
+        }
+
+        dvec2 ref = reference(m);
+        dvec2 z = ref + dz;
+        double z2 = dot(z, z);
+
+        // Stop condition: radius > 2 guaranteed does not belong to the set
+        if (z2 > 4.0)
+            return vec2(float(i - 1), smooth_iteration(z, reference(1) + dc, i - 1));
+
+        // Rebase when dz cancels Z (Pauldelbrot glitch) or the orbit ends.
+        if (z2 < 1e-6 * dot(ref, ref) || z2 < dot(dz, dz) || m == u_orbit_length - 1) {
+            dz = z;
+            m = 0;
+        }
+    }
+
+    // If reaches here, the point is considered in the set
+    return vec2(u_max_iter);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    if (!on_grid(pixel, u_step) || on_grid(pixel, u_prev_step))
+        discard;
+
+    if (u_keep_error >= 0.0) {
+        vec4 estimate = texelFetch(u_estimate, pixel, 0);
+        if (estimate.z <= u_keep_error) {
+            frag_iter = estimate;
+            return;
+        }
+    }
+
+    float ratio = u_width / u_height;
+    vec2 p_ = gl_FragCoord.xy / vec2(u_width, u_height);
+    vec2 p = 2.0*p_ - vec2(1.0);
+    p.x *= ratio;
+
+    dvec2 dc = u_offset + dvec2(p) / u_zoom;
+
+    frag_iter = vec4(mandelbrot(dc), 0.0, 0.0);
+}
@@ -0,0 +1,64 @@
+#include "gpu_timer.h"
+
+#include <algorithm>
+
+GpuTimer::GpuTimer()
+{
+    glGenQueries(RING_SIZE, queries_);
+}
+
+GpuTimer::~GpuTimer()
+{
+    close();
+}
+
+int GpuTimer::draws_within(double budget) const
+{
+    if (draw_seconds_ <= 0.0)
+        return 1;
+    return static_cast<int>(std::max(1.0, budget / draw_seconds_));
+}
+
+void GpuTimer::begin()
+{
+    timing_ = draws_[next_] == 0;
+    if (timing_)
+        glBeginQuery(GL_TIME_ELAPSED, queries_[next_]);
+}
+
+void GpuTimer::end(int draws)
+{
+    if (!timing_)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+    timing_ = false;
+    draws_[next_] = std::max(draws, 1);
+    next_ = (next_ + 1) % RING_SIZE;
+}
+
+void GpuTimer::poll()
+{
+    // Oldest first, so the newest result is the one kept.
+    for (int k = 0; k < RING_SIZE; ++k) {
+        const int slot = (next_ + k) % RING_SIZE;
+        if (draws_[slot] == 0)
+            continue;
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(queries_[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries_[slot], GL_QUERY_RESULT, &nanoseconds);
+        draw_seconds_ = static_cast<double>(nanoseconds) * 1e-9 / draws_[slot];
+        draws_[slot] = 0;
+    }
+}
+
+void GpuTimer::close()
+{
+    if (queries_[0] == 0)
+        return;
+    glDeleteQueries(RING_SIZE, queries_);
+    std::fill(queries_, queries_ + RING_SIZE, 0u);
+    std::fill(draws_, draws_ + RING_SIZE, 0);
+}
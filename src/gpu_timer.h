@@ -0,0 +1,41 @@
+#pragma once
+
+#include "glad/glad.h"
+
+// GPU time of batches of equal draws, without stalling the render loop.
+// Each batch is timed by one of a ring of GL_TIME_ELAPSED queries, read
+// frames later once its result is available. The last result tells how
+// long one draw takes, so callers can size the next batch to a budget.
+class GpuTimer
+{
+public:
+    static constexpr int RING_SIZE = 4;
+
+    // Needs the GL context current, as every other call does.
+    GpuTimer();
+    ~GpuTimer();
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    // Draws that fit in budget seconds, at least one. Only one as long as
+    // nothing was measured yet.
+    int draws_within(double budget) const;
+
+    // Time the draws issued until end(). Batches are not timed while every
+    // query of the ring is still on the GPU.
+    void begin();
+    void end(int draws);
+
+    // Collect the results the GPU is done with. Once per frame.
+    void poll();
+
+    // Delete the queries, before the GL context goes away.
+    void close();
+
+private:
+    GLuint queries_[RING_SIZE] = {};
+    int draws_[RING_SIZE] = {}; // of the batch in flight, 0 when free
+    int next_ = 0;
+    bool timing_ = false;
+    double draw_seconds_ = 0.0;
+};
@@ -0,0 +1,278 @@
+#include "json.h"
+
+#include <algorithm>
+#include <cstdint>
+
+// Deeper documents are refused rather than overflow the stack.
+static constexpr int MAX_DEPTH = 64;
+
+const JsonValue* JsonValue::find(const std::string& key) const
+{
+    for (const auto& member : members) {
+        if (member.first == key)
+            return &member.second;
+    }
+    return nullptr;
+}
+
+namespace {
+
+class JsonParser
+{
+public:
+    JsonParser(const std::string& text, std::string& error) : text_(text), error_(error) {}
+
+    bool parse_document(JsonValue& value)
+    {
+        if (!parse_value(value, 0))
+            return false;
+        skip_space();
+        return pos_ == text_.size() || fail("unexpected text after the document");
+    }
+
+private:
+    bool fail(const std::string& what)
+    {
+        const size_t end = std::min(pos_, text_.size());
+        const long line = 1 + std::count(text_.begin(), text_.begin() + end, '\n');
+        error_ = "line " + std::to_string(line) + ": " + what;
+        return false;
+    }
+
+    void skip_space()
+    {
+        while (pos_ < text_.size() &&
+               (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' || text_[pos_] == '\r'))
+            ++pos_;
+    }
+
+    bool consume(char c)
+    {
+        skip_space();
+        if (pos_ < text_.size() && text_[pos_] == c) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    bool consume_word(const char* word)
+    {
+        const std::string expected(word);
+        if (text_.compare(pos_, expected.size(), expected) != 0)
+            return false;
+        pos_ += expected.size();
+        return true;
+    }
+
+    bool parse_value(JsonValue& value, int depth)
+    {
+        if (depth > MAX_DEPTH)
+            return fail("nested too deep");
+        skip_space();
+        if (pos_ == text_.size())
+            return fail("unexpected end of file");
+
+        value = JsonValue();
+        const char c = text_[pos_];
+        if (c == '{')
+            return parse_object(value, depth);
+        if (c == '[')
+            return parse_array(value, depth);
+        if (c == '"') {
+            value.type = JsonValue::Type::String;
+            return parse_string(value.text);
+        }
+        if (c == '-' || (c >= '0' && c <= '9'))
+            return parse_number(value);
+        if (consume_word("true")) {
+            value.type = JsonValue::Type::Bool;
+            value.boolean = true;
+            return true;
+        }
+        if (consume_word("false")) {
+            value.type = JsonValue::Type::Bool;
+            return true;
+        }
+        if (consume_word("null"))
+            return true;
+        return fail(std::string("unexpected character '") + c + "'");
+    }
+
+    bool parse_object(JsonValue& value, int depth)
+    {
+        value.type = JsonValue::Type::Object;
+        ++pos_;
+        if (consume('}'))
+            return true;
+        do {
+            skip_space();
+            std::string key;
+            if (pos_ == text_.size() || text_[pos_] != '"')
+                return fail("expected a member name");
+            if (!parse_string(key))
+                return false;
+            if (value.find(key))
+                return fail("duplicate member \"" + key + "\"");
+            if (!consume(':'))
+                return fail("expected ':' after \"" + key + "\"");
+            value.members.emplace_back(std::move(key), JsonValue());
+            if (!parse_value(value.members.back().second, depth + 1))
+                return false;
+        } while (consume(','));
+        return consume('}') || fail("expected ',' or '}'");
+    }
+
+    bool parse_array(JsonValue& value, int depth)
+    {
+        value.type = JsonValue::Type::Array;
+        ++pos_;
+        if (consume(']'))
+            return true;
+        do {
+            value.items.emplace_back();
+            if (!parse_value(value.items.back(), depth + 1))
+                return false;
+        } while (consume(','));
+        return consume(']') || fail("expected ',' or ']'");
+    }
+
+    // Grammar of JSON numbers, the text is kept as is.
+    bool parse_number(JsonValue& value)
+    {
+        auto digits = [this] {
+            const size_t start = pos_;
+            while (pos_ < text_.size() && text_[pos_] >= '0' && text_[pos_] <= '9')
+                ++pos_;
+            return pos_ > start;
+        };
+
+        const size_t start = pos_;
+        if (text_[pos_] == '-')
+            ++pos_;
+        if (pos_ < text_.size() && text_[pos_] == '0')
+            ++pos_;
+        else if (!digits())
+            return fail("invalid number");
+        if (pos_ < text_.size() && text_[pos_] == '.') {
+            ++pos_;
+            if (!digits())
+                return fail("invalid number");
+        }
+        if (pos_ < text_.size() && (text_[pos_] == 'e' || text_[pos_] == 'E')) {
+            ++pos_;
+            if (pos_ < text_.size() && (text_[pos_] == '+' || text_[pos_] == '-'))
+                ++pos_;
+            if (!digits())
+                return fail("invalid number");
+        }
+        value.type = JsonValue::Type::Number;
+        value.text = text_.substr(start, pos_ - start);
+        return true;
+    }
+
+    bool parse_hex4(uint32_t& code)
+    {
+        if (pos_ + 4 > text_.size())
+            return fail("invalid \\u escape");
+        code = 0;
+        for (int i = 0; i < 4; ++i) {
+            const char c = text_[pos_++];
+            code <<= 4;
+            if (c >= '0' && c <= '9')
+                code |= c - '0';
+            else if (c >= 'a' && c <= 'f')
+                code |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                code |= c - 'A' + 10;
+            else
+                return fail("invalid \\u escape");
+        }
+        return true;
+    }
+
+    static void append_utf8(uint32_t code, std::string& out)
+    {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        }
+        else if (code < 0x800) {
+            out += static_cast<char>(0xc0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        }
+        else if (code < 0x10000) {
+            out += static_cast<char>(0xe0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        }
+        else {
+            out += static_cast<char>(0xf0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        }
+    }
+
+    bool parse_string(std::string& out)
+    {
+        ++pos_; // opening quote
+        out.clear();
+        while (pos_ < text_.size()) {
+            const char c = text_[pos_++];
+            if (c == '"')
+                return true;
+            if (static_cast<unsigned char>(c) < 0x20)
+                return fail("control character in string");
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+
+            if (pos_ == text_.size())
+                break;
+            const char escape = text_[pos_++];
+            switch (escape) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                uint32_t code = 0;
+                if (!parse_hex4(code))
+                    return false;
+                // Characters past the first plane come as a surrogate pair.
+                if (code >= 0xd800 && code < 0xdc00) {
+                    uint32_t low = 0;
+                    if (!consume_word("\\u") || !parse_hex4(low) || low < 0xdc00 || low >= 0xe000)
+                        return fail("unpaired surrogate in \\u escape");
+                    code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                }
+                else if (code >= 0xdc00 && code < 0xe000) {
+                    return fail("unpaired surrogate in \\u escape");
+                }
+                append_utf8(code, out);
+                break;
+            }
+            default:
+                return fail(std::string("invalid escape \\") + escape);
+            }
+        }
+        return fail("unterminated string");
+    }
+
+    const std::string& text_;
+    std::string& error_;
+    size_t pos_ = 0;
+};
+
+} // namespace
+
+bool parse_json(const std::string& text, JsonValue& value, std::string& error)
+{
+    JsonParser parser(text, error);
+    return parser.parse_document(value);
+}
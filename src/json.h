@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Just enough JSON for job files: the whole grammar, no extensions, and
+// duplicate member names are refused rather than one of them picked.
+// Numbers keep their text as written, so centers parse with every digit
+// (see BigFixed::parse()) rather than rounded to double first.
+
+struct JsonValue
+{
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = Type::Null;
+    bool boolean = false;
+    std::string text; // number as written, or string unescaped
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> members; // in file order
+
+    // Member named key of an object, nullptr if none.
+    const JsonValue* find(const std::string& key) const;
+};
+
+// Parse a whole document. On failure error tells what and at which line.
+bool parse_json(const std::string& text, JsonValue& value, std::string& error);
@@ -0,0 +1,104 @@
+#include "kernel.h"
+
+template <typename T>
+EscapeResult<T> escape_time_dynamic(const KernelConfig& config, T cx, T cy, int max_iter)
+{
+    const bool smooth = (config.outputs & OUTPUT_SMOOTH) != 0;
+    const bool derivative = (config.outputs & OUTPUT_DISTANCE) != 0;
+
+    EscapeResult<T> result;
+    T zx = T(0);
+    T zy = T(0);
+    T dx = T(0);
+    T dy = T(0);
+    int n = 0;
+    bool escaped = false;
+    T sx = T(0);
+    T sy = T(0);
+    int save_at = 1;
+
+    // Same steps as escape_time(), every choice is made per iteration.
+    for (int i = -1; i < max_iter || escaped; ++i) {
+        T ax = zx;
+        T ay = zy;
+        if (config.formula == Formula::BurningShip) {
+            if (derivative) {
+                dx = zx < T(0) ? -dx : dx;
+                dy = zy < T(0) ? -dy : dy;
+            }
+            ax = std::fabs(zx);
+            ay = std::fabs(zy);
+        }
+
+        // w = z^(d-1)
+        const int power = config.formula == Formula::Power ? config.power : 2;
+        T wx = ax;
+        T wy = ay;
+        for (int k = 2; k < power; ++k) {
+            const T x = wx * ax - wy * ay;
+            const T y = wx * ay + wy * ax;
+            wx = x;
+            wy = y;
+        }
+        if (derivative) {
+            const T x = T(power) * (wx * dx - wy * dy) + T(1);
+            const T y = T(power) * (wx * dy + wy * dx);
+            dx = x;
+            dy = y;
+        }
+        const T x = wx * ax - wy * ay + cx;
+        const T y = wx * ay + wy * ax + cy;
+        zx = x;
+        zy = y;
+
+        // z_1 = c, the starting point of the cycle check.
+        if (i < 0) {
+            sx = zx;
+            sy = zy;
+            continue;
+        }
+
+        const T r2 = zx * zx + zy * zy;
+        if (!escaped && r2 > T(4)) {
+            escaped = true;
+            result.iter = i;
+            n = i;
+            if (!smooth && !derivative)
+                return result;
+        }
+        if (escaped) {
+            if (r2 > T(OUTPUT_RADIUS2) || n - result.iter == 8)
+                break;
+            ++n;
+        }
+        else {
+            const T ex = zx - sx;
+            const T ey = zy - sy;
+            if (ex * ex + ey * ey < cycle_tolerance2<T>())
+                break;
+            if (i == save_at) {
+                sx = zx;
+                sy = zy;
+                save_at *= 2;
+            }
+        }
+    }
+
+    if (!escaped) {
+        result.iter = max_iter;
+        result.smooth = T(max_iter);
+        return result;
+    }
+
+    const T r2 = zx * zx + zy * zy;
+    const T log_r = T(0.5) * std::log(r2);
+    const T degree = T(config.formula == Formula::Power ? config.power : 2);
+    if (smooth)
+        result.smooth = T(n) - std::log(log_r / T(0.6931471805599453)) / std::log(degree);
+    if (derivative)
+        result.distance = T(0.5) * std::sqrt(r2) * log_r / std::sqrt(dx * dx + dy * dy);
+    return result;
+}
+
+template EscapeResult<float> escape_time_dynamic(const KernelConfig&, float, float, int);
+template EscapeResult<double> escape_time_dynamic(const KernelConfig&, double, double, int);
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <cmath>
+#include <limits>
+
+// Escape-time kernel specialized at compile time on the formula, the scalar
+// type and the outputs the coloring needs, so the loop carries no branch on
+// any of them and outputs nobody asked for cost nothing.
+
+enum class Formula
+{
+    Mandelbrot,  // z^2 + c
+    Power,       // z^d + c
+    BurningShip, // (|x| + i|y|)^2 + c
+};
+
+// Outputs computed beside the escape iteration, combined as flags.
+enum KernelOutputs : unsigned
+{
+    OUTPUT_NONE = 0,
+    OUTPUT_SMOOTH = 1,   // continuous iteration count
+    OUTPUT_DISTANCE = 2, // distance estimate, tracks the derivative dz/dc
+};
+
+template <typename T>
+struct EscapeResult
+{
+    int iter = 0;       // same numbering as mandelbrot(), max_iter inside the set
+    T smooth = T(0);    // iter with the fraction of the last step, if OUTPUT_SMOOTH
+    T distance = T(0);  // to the set boundary in C, if OUTPUT_DISTANCE; 0 inside
+};
+
+// Squared radius the smooth and distance outputs keep iterating to after
+// escaping radius 2, both are only accurate for large |z|.
+constexpr double OUTPUT_RADIUS2 = 65536.0;
+
+// Whether c is in the main cardioid or the period-2 bulb of z^2 + c, where
+// orbits never escape. Closed form, so these pixels cost no iteration.
+template <typename T>
+inline bool in_main_bulbs(T cx, T cy)
+{
+    const T y2 = cy * cy;
+    const T x = cx - T(0.25);
+    const T q = x * x + y2;
+    if (q * (q + x) <= T(0.25) * y2)
+        return true;
+
+    const T x1 = cx + T(1);
+    return x1 * x1 + y2 <= T(0.0625);
+}
+
+// Rows with |cy| above this miss both, the cardioid reaches 0.6496.
+constexpr double MAIN_BULBS_MAX_Y = 0.65;
+
+// Squared distance under which an orbit is taken as back on a point it
+// visited, so caught in a cycle. A few units in the last place of T around
+// |z| = 1, interior orbits settle on their cycle to within rounding.
+template <typename T>
+constexpr T cycle_tolerance2()
+{
+    return T(16) * std::numeric_limits<T>::epsilon() * T(16) * std::numeric_limits<T>::epsilon();
+}
+
+// z = z^Power, with z^(Power - 1) in w, for the derivative.
+template <int Power, typename T>
+inline void complex_power(T& zx, T& zy, T& wx, T& wy)
+{
+    wx = zx;
+    wy = zy;
+    for (int k = 2; k < Power; ++k) {
+        const T x = wx * zx - wy * zy;
+        const T y = wx * zy + wy * zx;
+        wx = x;
+        wy = y;
+    }
+    const T x = wx * zx - wy * zy;
+    const T y = wx * zy + wy * zx;
+    zx = x;
+    zy = y;
+}
+
+// One step z = f(z) + c, and dz = f'(z) dz + 1 when Derivative is set.
+template <Formula F, int Power, bool Derivative, typename T>
+inline void formula_step(T& zx, T& zy, T& dx, T& dy, T cx, T cy)
+{
+    if constexpr (F == Formula::Mandelbrot) {
+        if constexpr (Derivative) {
+            // dz = 2 z dz + 1
+            const T x = T(2) * (zx * dx - zy * dy) + T(1);
+            const T y = T(2) * (zx * dy + zy * dx);
+            dx = x;
+            dy = y;
+        }
+        // Same operations as frag.glsl, results match the SIMD kernels.
+        const T x = zx * zx - zy * zy + cx;
+        const T y = zx * zy + zy * zx + cy;
+        zx = x;
+        zy = y;
+    }
+    else if constexpr (F == Formula::Power) {
+        static_assert(Power >= 2, "z^d + c needs d >= 2");
+        T wx, wy;
+        complex_power<Power>(zx, zy, wx, wy);
+        zx += cx;
+        zy += cy;
+        if constexpr (Derivative) {
+            // dz = d z^(d-1) dz + 1
+            const T x = T(Power) * (wx * dx - wy * dy) + T(1);
+            const T y = T(Power) * (wx * dy + wy * dx);
+            dx = x;
+            dy = y;
+        }
+    }
+    else {
+        // The fold (x, y) -> (|x|, |y|) flips the sign of the derivative
+        // along the axes it mirrors.
+        const T ax = std::fabs(zx);
+        const T ay = std::fabs(zy);
+        if constexpr (Derivative) {
+            const T fx = zx < T(0) ? -dx : dx;
+            const T fy = zy < T(0) ? -dy : dy;
+            const T x = T(2) * (ax * fx - ay * fy) + T(1);
+            const T y = T(2) * (ax * fy + ay * fx);
+            dx = x;
+            dy = y;
+        }
+        const T x = ax * ax - ay * ay + cx;
+        const T y = ax * ay + ay * ax + cy;
+        zx = x;
+        zy = y;
+    }
+}
+
+// Smooth iteration and distance of a point that escaped at step iter, z is
+// already past radius 2. A few more steps take it past OUTPUT_RADIUS2.
+template <Formula F, int Power, unsigned Outputs, typename T>
+inline void escape_outputs(T zx, T zy, T dx, T dy, T cx, T cy, int iter, EscapeResult<T>& result)
+{
+    constexpr bool derivative = (Outputs & OUTPUT_DISTANCE) != 0;
+    constexpr T degree = T(F == Formula::Power ? Power : 2);
+
+    int n = iter;
+    T r2 = zx * zx + zy * zy;
+    // Bounded, float z can overflow before reaching the radius.
+    for (int extra = 0; extra < 8 && r2 <= T(OUTPUT_RADIUS2); ++extra) {
+        formula_step<F, Power, derivative>(zx, zy, dx, dy, cx, cy);
+        r2 = zx * zx + zy * zy;
+        ++n;
+    }
+
+    // log|z| grows d times per step, so n - log_d(log|z| / log 2) falls
+    // back to about iter wherever |z| crossed 2.
+    const T log_r = T(0.5) * std::log(r2);
+    if constexpr ((Outputs & OUTPUT_SMOOTH) != 0)
+        result.smooth = T(n) - std::log(log_r / T(0.6931471805599453)) / std::log(degree);
+    if constexpr (derivative)
+        result.distance = T(0.5) * std::sqrt(r2) * log_r / std::sqrt(dx * dx + dy * dy);
+}
+
+template <Formula F, typename T, unsigned Outputs = OUTPUT_NONE, int Power = 2>
+inline EscapeResult<T> escape_time(T cx, T cy, int max_iter)
+{
+    constexpr bool derivative = (Outputs & OUTPUT_DISTANCE) != 0;
+
+    EscapeResult<T> result;
+    T zx = T(0);
+    T zy = T(0);
+    T dx = T(0);
+    T dy = T(0);
+
+    // z_1 = c and dz_1 = 1 for every formula, the loop starts at z_2 like
+    // frag.glsl does.
+    formula_step<F, Power, derivative>(zx, zy, dx, dy, cx, cy);
+
+    // Brent: compare z with a point saved at steps 1, 2, 4, 8... so a cycle
+    // of any period is caught within twice its length once it settles.
+    T sx = zx;
+    T sy = zy;
+    int save_at = 1;
+
+    for (int i = 0; i < max_iter; ++i) {
+        formula_step<F, Power, derivative>(zx, zy, dx, dy, cx, cy);
+
+        // Stop condition: radius > 2 guaranteed does not belong to the set
+        if (zx * zx + zy * zy > T(4)) {
+            result.iter = i;
+            if constexpr (Outputs != OUTPUT_NONE)
+                escape_outputs<F, Power, Outputs>(zx, zy, dx, dy, cx, cy, i, result);
+            return result;
+        }
+
+        const T ex = zx - sx;
+        const T ey = zy - sy;
+        if (ex * ex + ey * ey < cycle_tolerance2<T>())
+            break;
+        if (i == save_at) {
+            sx = zx;
+            sy = zy;
+            save_at *= 2;
+        }
+    }
+
+    result.iter = max_iter;
+    result.smooth = T(max_iter);
+    return result;
+}
+
+// The same kernel with the formula and outputs chosen at runtime, branching
+// inside the loop. Only there to measure what the specialization saves.
+struct KernelConfig
+{
+    Formula formula = Formula::Mandelbrot;
+    int power = 2;
+    unsigned outputs = OUTPUT_NONE;
+};
+
+// Defined for T = float and double.
+template <typename T>
+EscapeResult<T> escape_time_dynamic(const KernelConfig& config, T cx, T cy, int max_iter);
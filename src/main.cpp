@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 #include <fstream> // for std::ifstream
 #include <string>
@@ -7,54 +10,232 @@
 #include "GLFW/glfw3.h"
 #include "glad/glad.h"
 
+#if defined(ZOOM_EGL)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
+#include "capture.h"
+#include "fractal.h"
+#include "gpu_timer.h"
+#include "perturbation.h"
+#include "poster.h"
+
 
 GLuint create_shader_program(const std::string& vert_file,
                              const std::string& frag_file);
 
+// View state is kept in double, and the center in arbitrary precision for
+// perturbation. It is only rounded to what the shader in use takes.
 struct Input
 {
-    float zoom = 1.0f;
-    float center[2] = {0.0f, 0.0f};
+    double zoom = 1.0;
+    BigFixed center[2] = {0.0, 0.0};
     float width = 100.0f;
     float height = 100.0f;
+    int max_iter = 200;
     bool capture = false;
+    bool poster = false;
+    bool progressive = false; // iterate over several frames, coarse to fine
+
+    // Colorize pass only.
+    int palette = 0;
+    float exposure = 1.0f;
+    bool smooth = false;
+
+    // What changed since the last frame drawn: a new view needs the fractal
+    // iterated again, new colors only the colorize pass.
+    bool view_dirty = true;
+    bool colors_dirty = true;
 };
+
+// Progressive refinement interleaves pixels like Adam7 does, in 4x4 blocks.
+// After each pass the pixels iterated so far form a grid of this spacing,
+// twice as dense as after the pass before. The first one is a 1/16
+// resolution preview.
+static constexpr int REFINE_PASSES = 5;
+static constexpr int REFINE_STEP[REFINE_PASSES][2] = {{4, 4}, {2, 4}, {2, 2}, {1, 2}, {1, 1}};
+
+// After a zoom, pixels reprojected from the last frame are iterated again in
+// passes, those more than this many pixels off their point first, within a
+// time budget per frame. The last pass leaves only exact pixels. Passes go
+// in tiles of ERROR_TILE pixels a side, the budget is checked between them.
+static constexpr int ERROR_PASSES = 5;
+static constexpr float ERROR_THRESHOLDS[ERROR_PASSES] = {16.0f, 4.0f, 1.0f, 0.25f, 0.0f};
+static constexpr double ITERATION_BUDGET = 0.012; // seconds, leaves time for colors at 60 fps
+static constexpr int ERROR_TILE = 256;
+
+// Posters saved with O are this many times the window on each side, drawn
+// in tiles of at most POSTER_TILE pixels.
+static constexpr int POSTER_SCALE = 4;
+static constexpr int POSTER_TILE = 2048;
 static void processInput(GLFWwindow* window, Input& input);
-void dump_frame(const std::string& img_file, int width, int height);
+static void refresh_window(GLFWwindow* window);
+static void show_frame_counts(GLFWwindow* window, long long rendered, long long colorized,
+                              long long skipped);
+
+void create_iteration_target(int width, int height, GLuint& framebuffer, GLuint& texture);
+void shift_iterations(GLuint source, GLuint target, int width, int height, const int shift[2]);
+void draw_exposed_strips(int width, int height, const int shift[2]);
+void upload_orbit(GLuint orbit_buffer, const ReferenceOrbit& orbit);
+void upload_bla(GLuint program, GLuint bla_buffer, const BlaTable<double>& bla);
 
+void set_uniform_1i(GLuint program, const char* uniform_name, int value);
+void set_uniform_1iv(GLuint program, const char* uniform_name, int count, const int* values);
 void set_uniform_1f(GLuint program, const char* uniform_name, float value);
+void set_uniform_2i(GLuint program, const char* uniform_name, int x, int y);
 void set_uniform_2f(GLuint program, const char* uniform_name, float x, float y);
+void set_uniform_1d(GLuint program, const char* uniform_name, double value);
+void set_uniform_2d(GLuint program, const char* uniform_name, double x, double y);
 
-int main()
+static void print_usage()
 {
-    if (!glfwInit()) {
-        return -1;
+    std::cout << "Usage: zoom [--poster W H FILE [options]]\n"
+              << "  --poster W H FILE  save a W x H render of the view to FILE and exit,\n"
+              << "                     without showing the window\n"
+              << "  --center X Y       center of the view (default 0 0)\n"
+              << "  --zoom Z           zoom factor (default 1)\n"
+              << "  --max-iter N       iteration limit (default 200)\n"
+              << "  --palette N        palette, 0 to " << PALETTE_COUNT - 1 << " (default 0)\n"
+              << "  --smooth           smooth coloring\n";
+}
+
+#if defined(ZOOM_EGL)
+// OpenGL 4.0 core context without any surface, on the surfaceless platform
+// of Mesa: posters draw to framebuffers of their own, so they need neither a
+// window nor a display. EGL_NO_DISPLAY where the platform or the context is
+// not available.
+static EGLDisplay create_surfaceless_context()
+{
+    const char* client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    const auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+        eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (!client_extensions || !std::strstr(client_extensions, "EGL_MESA_platform_surfaceless") ||
+        !get_platform_display)
+        return EGL_NO_DISPLAY;
+
+    EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+        return EGL_NO_DISPLAY;
+
+    const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+    const EGLint attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 0,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = EGL_NO_CONTEXT;
+    if (extensions && std::strstr(extensions, "EGL_KHR_no_config_context") &&
+        std::strstr(extensions, "EGL_KHR_surfaceless_context") && eglBindAPI(EGL_OPENGL_API))
+        context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        eglTerminate(display);
+        return EGL_NO_DISPLAY;
     }
+    return display;
+}
+#endif
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    // #TODO: make it resizable
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+int main(int argc, char** argv)
+{
+    // The view to start from, and for a poster what to save.
+    Input input;
+    std::string poster_file;
+    int poster_size[2] = {0, 0};
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const int args_left = argc - i - 1;
+        if (arg == "--poster" && args_left >= 3) {
+            poster_size[0] = std::atoi(argv[++i]);
+            poster_size[1] = std::atoi(argv[++i]);
+            poster_file = argv[++i];
+        }
+        else if (arg == "--center" && args_left >= 2) {
+            if (!BigFixed::parse(argv[i + 1], input.center[0]) ||
+                !BigFixed::parse(argv[i + 2], input.center[1])) {
+                std::cout << "Invalid center " << argv[i + 1] << " " << argv[i + 2] << "\n";
+                return -1;
+            }
+            i += 2;
+        }
+        else if (arg == "--zoom" && args_left >= 1) {
+            input.zoom = std::atof(argv[++i]);
+        }
+        else if (arg == "--max-iter" && args_left >= 1) {
+            input.max_iter = std::atoi(argv[++i]);
+        }
+        else if (arg == "--palette" && args_left >= 1) {
+            input.palette = std::atoi(argv[++i]);
+        }
+        else if (arg == "--smooth") {
+            input.smooth = true;
+        }
+        else if (arg == "--help" || arg == "-h") {
+            print_usage();
+            return 0;
+        }
+        else {
+            std::cout << "Unknown option " << arg << "\n";
+            print_usage();
+            return -1;
+        }
+    }
+    if (input.zoom <= 0.0 || input.max_iter <= 0 || input.palette < 0 ||
+        input.palette >= PALETTE_COUNT ||
+        (!poster_file.empty() && (poster_size[0] <= 0 || poster_size[1] <= 0))) {
+        std::cout << "Invalid view parameters.\n";
+        return -1;
+    }
 
     const int width = 1280;
     const int height = 960;
-    GLFWwindow* window = glfwCreateWindow(width, height, "Mandelbrot Zoom", NULL, NULL);
+    GLFWwindow* window = nullptr;
 
-    if (!window) {
-        glfwTerminate();
-        return -1;
+    // A poster is drawn without a window where EGL allows it, so it also
+    // runs where there is no display. Otherwise, and for the interactive
+    // view, GLFW makes the context.
+    bool surfaceless = false;
+#if defined(ZOOM_EGL)
+    EGLDisplay egl_display = EGL_NO_DISPLAY;
+    if (!poster_file.empty()) {
+        egl_display = create_surfaceless_context();
+        surfaceless = egl_display != EGL_NO_DISPLAY &&
+                      gladLoadGLLoader((GLADloadproc)eglGetProcAddress);
     }
+#endif
 
-    glfwMakeContextCurrent(window);
+    if (!surfaceless) {
+        if (!glfwInit()) {
+            return -1;
+        }
 
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-        std::cout << "Failed to create OpenGL context.\n";
-        glfwTerminate();
-        return -1;
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        // #TODO: make it resizable
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+        // Posters are drawn offscreen, the window only holds the context.
+        if (!poster_file.empty())
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+        window = glfwCreateWindow(width, height, "Mandelbrot Zoom", NULL, NULL);
+
+        if (!window) {
+            glfwTerminate();
+            return -1;
+        }
+
+        glfwMakeContextCurrent(window);
+
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+            std::cout << "Failed to create OpenGL context.\n";
+            glfwTerminate();
+            return -1;
+        }
     }
 
     glClearColor(115.f/255, 38.f/255, 115.f/255, 1.f);
@@ -94,43 +275,441 @@ int main()
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), (void*)indices, GL_STATIC_DRAW);
 
-    // Shader program.
+    // Shader programs, the double precision one takes over when float can no
+    // longer tell pixels apart.
     GLuint shader_program = create_shader_program("../src/vert.glsl",
                                                   "../src/frag.glsl");
-    glUseProgram(shader_program);
+    GLuint shader_program_64 = create_shader_program("../src/vert.glsl",
+                                                     "../src/frag64.glsl");
+    GLuint shader_program_deep = create_shader_program("../src/vert.glsl",
+                                                       "../src/frag_perturb.glsl");
+
+    // Any of them writes iteration counts to an offscreen texture, which
+    // colorize.glsl then turns into the colors on screen.
+    GLuint colorize_program = create_shader_program("../src/vert.glsl",
+                                                    "../src/colorize.glsl");
+    GLuint reproject_program = create_shader_program("../src/vert.glsl",
+                                                     "../src/reproject.glsl");
+
+    // Two of them: panning copies the last frame into the other one,
+    // shifted, and only iterates the pixels that came into view. Zooming
+    // stretches it over the other one with reproject.glsl.
+    GLuint iteration_framebuffer[2];
+    GLuint iteration_texture[2];
+    for (int k = 0; k < 2; ++k)
+        create_iteration_target(width, height, iteration_framebuffer[k], iteration_texture[k]);
+    int current_target = 0;
+
+    // Draws go to one of them while the other one, on texture unit 3,
+    // holds the frame before.
+    auto use_target = [&](int target) {
+        current_target = target;
+        glBindFramebuffer(GL_FRAMEBUFFER, iteration_framebuffer[target]);
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, iteration_texture[1 - target]);
+    };
+
+    // Reference orbit for perturbation, read by the shader as a buffer texture.
+    GLuint orbit_buffer;
+    glGenBuffers(1, &orbit_buffer);
+    GLuint orbit_texture;
+    glGenTextures(1, &orbit_texture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, orbit_texture);
+    ReferenceOrbit orbit;
+
+    // BLA table to skip iterations of the perturbation shader.
+    GLuint bla_buffer;
+    glGenBuffers(1, &bla_buffer);
+    GLuint bla_texture;
+    glGenTextures(1, &bla_texture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, bla_texture);
+    BlaTable<double> bla;
 
-    Input input;
     input.width = static_cast<float>(width);
     input.height = static_cast<float>(height);
 
-    while (!glfwWindowShouldClose(window))
-    {
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // View of the window, or of a poster scale times its size.
+    auto window_view = [&](int scale) {
+        View view;
+        view.zoom = input.zoom;
+        view.center[0] = input.center[0];
+        view.center[1] = input.center[1];
+        view.width = width * scale;
+        view.height = height * scale;
+        view.max_iter = input.max_iter;
+        return view;
+    };
+
+    // Make current the iteration program view needs. For perturbation the
+    // reference orbit and BLA table are brought up to date first, they then
+    // hold for any part of view too.
+    auto use_iteration_program = [&](const View& view) {
+        if (needs_perturbation(view)) {
+            // New reference when the view left the old one, or needs more
+            // precision or iterations than it was computed with.
+            const double zoom = view.zoom.to_double();
+            const double offset[2] = {(view.center[0] - orbit.center[0]).to_double(),
+                                      (view.center[1] - orbit.center[1]).to_double()};
+            if (orbit.length() == 0 || orbit.max_iter != view.max_iter ||
+                orbit.precision_bits < precision_for_zoom(view.zoom) ||
+                std::fabs(offset[0]) * zoom > 1.0 || std::fabs(offset[1]) * zoom > 1.0) {
+                compute_reference_orbit(view.center[0], view.center[1], view.max_iter,
+                                        precision_for_zoom(view.zoom * 1e3), orbit);
+                upload_orbit(orbit_buffer, orbit);
+                glActiveTexture(GL_TEXTURE0);
+                glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32UI, orbit_buffer);
+                bla = BlaTable<double>();
+            }
+
+            // The table holds for pixels up to dc_max from the reference,
+            // built with some margin so zooming out does not rebuild it
+            // every frame.
+            const double dc_max = max_pixel_offset(view).to_double() + std::hypot(offset[0], offset[1]);
+            if (bla.level_count() == 0 || bla.dc_max() < dc_max) {
+                bla.build(orbit, 2.0 * dc_max);
+                upload_bla(shader_program_deep, bla_buffer, bla);
+                glActiveTexture(GL_TEXTURE1);
+                glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32UI, bla_buffer);
+            }
+
+            glUseProgram(shader_program_deep);
+            set_uniform_1i(shader_program_deep, "u_orbit", 0);
+            set_uniform_1i(shader_program_deep, "u_orbit_length", orbit.length());
+            set_uniform_1i(shader_program_deep, "u_bla", 1);
+            return shader_program_deep;
+        }
+        const GLuint program = needs_double(view) ? shader_program_64 : shader_program;
+        glUseProgram(program);
+        return program;
+    };
+
+    // Uniforms of the view drawn by program, in the precision it takes.
+    auto set_view_uniforms = [&](GLuint program, const View& view) {
+        const double zoom = view.zoom.to_double();
+        if (program == shader_program_deep) {
+            set_uniform_1d(program, "u_zoom", zoom);
+            set_uniform_2d(program, "u_offset", (view.center[0] - orbit.center[0]).to_double(),
+                           (view.center[1] - orbit.center[1]).to_double());
+        }
+        else if (program == shader_program_64) {
+            set_uniform_1d(program, "u_zoom", zoom);
+            set_uniform_2d(program, "u_center", view.center[0].to_double(),
+                           view.center[1].to_double());
+        }
+        else {
+            set_uniform_1f(program, "u_zoom", static_cast<float>(zoom));
+            set_uniform_2f(program, "u_center", static_cast<float>(view.center[0].to_double()),
+                           static_cast<float>(view.center[1].to_double()));
+        }
+        set_uniform_1f(program, "u_width", static_cast<float>(view.width));
+        set_uniform_1f(program, "u_height", static_cast<float>(view.height));
+        set_uniform_1i(program, "u_max_iter", view.max_iter);
+    };
+
+    // Render view offscreen in tiles and save it, colored like the window.
+    // The program is picked for the whole view, tiles only move its center.
+    auto save_poster = [&](const View& view, const std::string& file) {
+        const GLuint program = use_iteration_program(view);
+        PosterPasses passes;
+        passes.iterate = [&](const View& tile) {
+            glUseProgram(program);
+            set_view_uniforms(program, tile);
+            set_uniform_1i(program, "u_estimate", 3);
+            set_uniform_1f(program, "u_keep_error", -1.0f);
+            set_uniform_2i(program, "u_step", 1, 1);
+            set_uniform_2i(program, "u_prev_step", 0, 0);
+            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)0);
+        };
+        passes.colorize = [&](GLuint iterations) {
+            glUseProgram(colorize_program);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, iterations);
+            set_uniform_1i(colorize_program, "u_iterations", 2);
+            set_uniform_1i(colorize_program, "u_max_iter", view.max_iter);
+            set_uniform_1i(colorize_program, "u_palette", input.palette);
+            set_uniform_1f(colorize_program, "u_exposure", input.exposure);
+            set_uniform_1i(colorize_program, "u_smooth", input.smooth);
+            set_uniform_2i(colorize_program, "u_step", 1, 1);
+            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)0);
+        };
+
+        PosterStats stats;
+        if (!render_poster(view, passes, file, POSTER_TILE, &stats)) {
+            std::cout << "Unable to write file " << file << std::endl;
+            return false;
+        }
+        std::cout << "Saved image " << file << " (" << view.width << "x" << view.height << ", "
+                  << stats.tiles << " tiles of " << stats.tile_width << "x" << stats.tile_height
+                  << ", " << stats.seconds << " s, " << stats.wait_seconds << " s waiting on the GPU)"
+                  << std::endl;
+        return true;
+    };
+
+    // The window needs drawing again when it was uncovered, even though
+    // nothing changed.
+    if (window) {
+        glfwSetWindowUserPointer(window, &input);
+        glfwSetWindowRefreshCallback(window, refresh_window);
+    }
+
+    // Frames where the fractal was iterated, only colored again, or not
+    // drawn at all because nothing changed.
+    long long frames_rendered = 0;
+    long long frames_colorized = 0;
+    long long frames_skipped = 0;
+    bool idle = false;
+    // Passes of the current view iterated so far, by the progressive
+    // refinement or after a zoom.
+    int refine_pass = REFINE_PASSES;
+    int error_pass = ERROR_PASSES;
+    int error_tile = 0; // next tile of the error pass
+
+    // View held by the current iteration texture, valid once it has a value
+    // for every pixel. The next frame shifts or stretches it when it can.
+    bool frame_valid = false;
+    double frame_zoom = 0.0;
+    BigFixed frame_center[2];
+    int frame_max_iter = 0;
+    GLuint frame_program = 0;
+
+    FrameCapture frame_capture(width, height);
+    GpuTimer tile_timer;
+
+    int exit_code = 0;
+    if (!poster_file.empty()) {
+        View view = window_view(1);
+        view.width = poster_size[0];
+        view.height = poster_size[1];
+        exit_code = save_poster(view, poster_file) ? 0 : -1;
+        if (window)
+            glfwSetWindowShouldClose(window, GLFW_TRUE);
+    }
 
-        glfwPollEvents();
+    while (window && !glfwWindowShouldClose(window))
+    {
+        // Sleep until the next event once nothing moves anymore, keys held
+        // down keep the loop polling. Captures still on the GPU are checked
+        // every few milliseconds.
+        if (idle && frame_capture.pending())
+            glfwWaitEventsTimeout(0.005);
+        else if (idle)
+            glfwWaitEvents();
+        else
+            glfwPollEvents();
         processInput(window, input);
-        set_uniform_1f(shader_program, "u_zoom", input.zoom);
-        set_uniform_2f(shader_program, "u_center", input.center[0], input.center[1]);
-        set_uniform_1f(shader_program, "u_width", input.width);
-        set_uniform_1f(shader_program, "u_height", input.height);
+        frame_capture.poll();
 
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)0);
+        // Not a frame of the window, the GPU is busy with it for a while.
+        if (input.poster) {
+            save_poster(window_view(POSTER_SCALE), unique_capture_name("poster"));
+            input.poster = false;
+        }
 
-        glfwSwapBuffers(window);
+        const bool iterate = input.view_dirty || refine_pass < REFINE_PASSES ||
+                             error_pass < ERROR_PASSES;
 
-        if(input.capture) {
-            dump_frame("dump.png", width, height);
-            input.capture = false;
+        idle = !iterate && !input.colors_dirty;
+        if (idle) {
+            ++frames_skipped;
+            show_frame_counts(window, frames_rendered, frames_colorized, frames_skipped);
+            continue;
         }
+
+        if (iterate) {
+            // Iteration pass.
+            const View view = window_view(1);
+            const GLuint iteration_program = use_iteration_program(view);
+            set_view_uniforms(iteration_program, view);
+            set_uniform_1i(iteration_program, "u_estimate", 3);
+            set_uniform_1f(iteration_program, "u_keep_error", -1.0f);
+            set_uniform_2i(iteration_program, "u_step", 1, 1);
+            set_uniform_2i(iteration_program, "u_prev_step", 0, 0);
+
+            if (input.view_dirty) {
+                // The last frame is a start for the new view if it was
+                // iterated the same way. Offsets in its pixels.
+                const bool reuse = frame_valid && frame_max_iter == input.max_iter &&
+                                   frame_program == iteration_program;
+                const double scale = frame_zoom / input.zoom;
+                double offset[2];
+                int shift[2];
+                bool pan = reuse && scale == 1.0;
+                for (int k = 0; k < 2; ++k) {
+                    offset[k] = (input.center[k] - frame_center[k]).to_double() *
+                                frame_zoom * input.height / 2.0;
+                    shift[k] = static_cast<int>(std::lround(offset[k]));
+                    pan = pan && std::fabs(offset[k] - shift[k]) < 1e-3 &&
+                          std::abs(shift[k]) < (k == 0 ? width : height);
+                }
+                const bool reproject = reuse && !pan && scale > 0.25 && scale < 4.0 &&
+                                       std::fabs(offset[0]) < width && std::fabs(offset[1]) < height;
+
+                if (pan) {
+                    // Pans move the center by whole pixels (see processInput),
+                    // the last frame holds all but the strips that came into
+                    // view. Estimates it still had go on being refined.
+                    shift_iterations(iteration_framebuffer[current_target],
+                                     iteration_framebuffer[1 - current_target], width, height, shift);
+                    use_target(1 - current_target);
+                    draw_exposed_strips(width, height, shift);
+                    refine_pass = REFINE_PASSES;
+                }
+                else if (reproject) {
+                    // Zooms stretch the last frame over the new view, then
+                    // pixels are iterated again from the furthest off.
+                    use_target(1 - current_target);
+                    glUseProgram(reproject_program);
+                    set_uniform_1i(reproject_program, "u_previous", 3);
+                    set_uniform_2f(reproject_program, "u_origin",
+                                   static_cast<float>(offset[0] + width * (1.0 - scale) / 2.0),
+                                   static_cast<float>(offset[1] + height * (1.0 - scale) / 2.0));
+                    set_uniform_1f(reproject_program, "u_scale", static_cast<float>(scale));
+                    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)0);
+                    glUseProgram(iteration_program);
+                    refine_pass = REFINE_PASSES;
+                    error_pass = 0;
+                }
+                else {
+                    // A new view drops whatever refinement of the old one
+                    // was left.
+                    refine_pass = 0;
+                    error_pass = ERROR_PASSES;
+                }
+
+                frame_zoom = input.zoom;
+                frame_center[0] = input.center[0];
+                frame_center[1] = input.center[1];
+                frame_max_iter = input.max_iter;
+                frame_program = iteration_program;
+                // Tiles done of an error pass were of the frame before.
+                error_tile = 0;
+            }
+
+            if (refine_pass < REFINE_PASSES) {
+                // Every pixel at once, or the next grid of the refinement.
+                const int* step = REFINE_STEP[REFINE_PASSES - 1];
+                const int* prev_step = nullptr;
+                if (input.progressive) {
+                    step = REFINE_STEP[refine_pass];
+                    prev_step = refine_pass > 0 ? REFINE_STEP[refine_pass - 1] : nullptr;
+                    ++refine_pass;
+                }
+                else {
+                    refine_pass = REFINE_PASSES;
+                }
+
+                use_target(current_target);
+                set_uniform_2i(iteration_program, "u_step", step[0], step[1]);
+                set_uniform_2i(iteration_program, "u_prev_step", prev_step ? prev_step[0] : 0,
+                               prev_step ? prev_step[1] : 0);
+                glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)0);
+            }
+            else {
+                // Each error pass copies the estimates within its threshold
+                // and iterates the rest, tile by tile, as many tiles as the
+                // GPU time of the last ones says fit in the frame. A pass
+                // starts from a copy of the frame before it, so the frame
+                // is whole wherever the budget stops it.
+                tile_timer.poll();
+                const int columns = (width + ERROR_TILE - 1) / ERROR_TILE;
+                const int tiles = columns * ((height + ERROR_TILE - 1) / ERROR_TILE);
+                const int budget_tiles = tile_timer.draws_within(ITERATION_BUDGET);
+                int drawn = 0;
+                if (error_pass < ERROR_PASSES)
+                    tile_timer.begin();
+                while (error_pass < ERROR_PASSES && drawn < budget_tiles) {
+                    if (error_tile == 0) {
+                        const int no_shift[2] = {0, 0};
+                        shift_iterations(iteration_framebuffer[current_target],
+                                         iteration_framebuffer[1 - current_target], width, height, no_shift);
+                        use_target(1 - current_target);
+                    }
+                    else if (drawn == 0) {
+                        use_target(current_target);
+                    }
+                    set_uniform_1f(iteration_program, "u_keep_error", ERROR_THRESHOLDS[error_pass]);
+
+                    glEnable(GL_SCISSOR_TEST);
+                    glScissor((error_tile % columns) * ERROR_TILE, (error_tile / columns) * ERROR_TILE,
+                              ERROR_TILE, ERROR_TILE);
+                    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)0);
+                    glDisable(GL_SCISSOR_TEST);
+                    ++drawn;
+                    if (++error_tile == tiles) {
+                        error_tile = 0;
+                        ++error_pass;
+                    }
+                }
+                tile_timer.end(drawn);
+            }
+            ++frames_rendered;
+
+            // Partial grids of the progressive refinement are no estimate
+            // of the pixels between them.
+            frame_valid = refine_pass == REFINE_PASSES;
+        }
+        else {
+            ++frames_colorized;
+        }
+
+        // Colorize pass.
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glUseProgram(colorize_program);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, iteration_texture[current_target]);
+        set_uniform_1i(colorize_program, "u_iterations", 2);
+        set_uniform_1i(colorize_program, "u_max_iter", input.max_iter);
+        set_uniform_1i(colorize_program, "u_palette", input.palette);
+        set_uniform_1f(colorize_program, "u_exposure", input.exposure);
+        set_uniform_1i(colorize_program, "u_smooth", input.smooth);
+        set_uniform_2i(colorize_program, "u_step", REFINE_STEP[refine_pass - 1][0],
+                       REFINE_STEP[refine_pass - 1][1]);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)0);
+
+        // Read before the swap, the back buffer is undefined after it. Not
+        // before refinement is done, the capture waits for the last pass.
+        // With the whole ring busy it is tried again on the next frame.
+        bool capture_busy = false;
+        if(input.capture && refine_pass == REFINE_PASSES && error_pass == ERROR_PASSES) {
+            capture_busy = !frame_capture.request(unique_capture_name());
+            input.capture = capture_busy;
+        }
+
+        glfwSwapBuffers(window);
+        input.view_dirty = false;
+        input.colors_dirty = capture_busy;
+        show_frame_counts(window, frames_rendered, frames_colorized, frames_skipped);
     }
 
+    frame_capture.close();
+    tile_timer.close();
     glDeleteBuffers(1, &vbo);
     glDeleteBuffers(1, &ebo);
+    glDeleteProgram(shader_program);
+    glDeleteProgram(shader_program_64);
+    glDeleteProgram(shader_program_deep);
+    glDeleteProgram(colorize_program);
+    glDeleteProgram(reproject_program);
+    glDeleteFramebuffers(2, iteration_framebuffer);
+    glDeleteTextures(2, iteration_texture);
+    glDeleteTextures(1, &orbit_texture);
+    glDeleteBuffers(1, &orbit_buffer);
+    glDeleteTextures(1, &bla_texture);
+    glDeleteBuffers(1, &bla_buffer);
 
-    glfwDestroyWindow(window);
-    glfwTerminate();
+#if defined(ZOOM_EGL)
+    if (egl_display != EGL_NO_DISPLAY)
+        eglTerminate(egl_display);
+#endif
+    if (window) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
 
-    return 0;
+    return exit_code;
 }
 
 
@@ -213,39 +792,243 @@ GLuint create_shader_program(const std::string& vert_file, const std::string& fr
 
 static void processInput(GLFWwindow* window, Input& input)
 {
-    static constexpr float move_speed = 0.01f;
-    static constexpr float zoom_speed = 1.01f;
+    // Pans go by whole pixels, so the last frame can be shifted over.
+    const double move_step = std::max(std::round(0.01 * input.height / 2.0), 1.0) * 2.0 / input.height;
+    static constexpr double zoom_speed = 1.01;
+    static constexpr double iter_speed = 1.02;
 
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, GLFW_TRUE);
 
     // Move left/right/up/down with WASD.
     // Zoom in/out with QE
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        input.center[1] += move_speed / input.zoom;
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        input.center[0] -= move_speed / input.zoom;
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        input.center[1] -= move_speed / input.zoom;
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        input.center[0] += move_speed / input.zoom;
-    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
+    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
+        input.center[1] += move_step / input.zoom;
+        input.view_dirty = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
+        input.center[0] -= move_step / input.zoom;
+        input.view_dirty = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
+        input.center[1] -= move_step / input.zoom;
+        input.view_dirty = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
+        input.center[0] += move_step / input.zoom;
+        input.view_dirty = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS) {
         input.zoom /= zoom_speed;
-    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
+        input.view_dirty = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS) {
         input.zoom *= zoom_speed;
-    if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS)
+        input.view_dirty = true;
+    }
+    // The capture is read back from a frame drawn for it, one per press of C.
+    static bool capture_down = false;
+    const bool capture_key = glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
+    if (capture_key && !capture_down) {
         input.capture = true;
+        input.colors_dirty = true;
+    }
+    capture_down = capture_key;
+    // A poster of the view at POSTER_SCALE times the window, one per press of O.
+    static bool poster_down = false;
+    const bool poster_key = glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS;
+    if (poster_key && !poster_down)
+        input.poster = true;
+    poster_down = poster_key;
+
+    // More/fewer iterations with RF, deep zooms need many more.
+    if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS) {
+        input.max_iter = static_cast<int>(input.max_iter * iter_speed) + 1;
+        input.view_dirty = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS) {
+        const int max_iter = std::max(static_cast<int>(input.max_iter / iter_speed), 1);
+        input.view_dirty |= max_iter != input.max_iter;
+        input.max_iter = max_iter;
+    }
+
+    // Next palette with P, smooth coloring on/off with G, exposure with [],
+    // progressive refinement on/off with M. Toggles act once per key press.
+    static bool palette_down = false;
+    static bool smooth_down = false;
+    static bool progressive_down = false;
+    const bool palette_key = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+    const bool smooth_key = glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS;
+    const bool progressive_key = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+    if (progressive_key && !progressive_down) {
+        input.progressive = !input.progressive;
+        input.view_dirty = true;
+    }
+    progressive_down = progressive_key;
+    if (palette_key && !palette_down) {
+        input.palette = (input.palette + 1) % PALETTE_COUNT;
+        input.colors_dirty = true;
+    }
+    if (smooth_key && !smooth_down) {
+        input.smooth = !input.smooth;
+        input.colors_dirty = true;
+    }
+    palette_down = palette_key;
+    smooth_down = smooth_key;
+
+    if (glfwGetKey(window, GLFW_KEY_LEFT_BRACKET) == GLFW_PRESS) {
+        input.exposure /= static_cast<float>(iter_speed);
+        input.colors_dirty = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS) {
+        input.exposure *= static_cast<float>(iter_speed);
+        input.colors_dirty = true;
+    }
 }
 
-void dump_frame(const std::string& img_file, int width, int height)
+static void refresh_window(GLFWwindow* window)
 {
-    std::cout << "Saving image " + img_file << std::endl;
-    const int stride = width * 3;
-    std::vector<unsigned char> buffer;
-    buffer.resize(stride * height);
-    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, buffer.data());
-    //stbi_flip_vertically_on_write(true);
-    stbi_write_png(img_file.c_str(), width, height, 3, buffer.data(), stride * sizeof(unsigned char));
+    Input* input = static_cast<Input*>(glfwGetWindowUserPointer(window));
+    input->colors_dirty = true;
+}
+
+static void show_frame_counts(GLFWwindow* window, long long rendered, long long colorized,
+                              long long skipped)
+{
+    const std::string title = "Mandelbrot Zoom - " + std::to_string(rendered) + " rendered, " +
+        std::to_string(colorized) + " recolored, " + std::to_string(skipped) + " skipped";
+    glfwSetWindowTitle(window, title.c_str());
+}
+
+void create_iteration_target(int width, int height, GLuint& framebuffer, GLuint& texture)
+{
+    // Floats per pixel: escape iteration, smooth iteration count and how
+    // many pixels off a reprojected estimate may be (0 once iterated), the
+    // fourth is unused. Integers up to 2^24 are exact in float.
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "Iteration framebuffer is incomplete.\n";
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void shift_iterations(GLuint source, GLuint target, int width, int height, const int shift[2])
+{
+    // Pixel (x, y) of the new view is pixel (x + shift[0], y + shift[1]) of
+    // the old one. Same format on both sides, so the blit copies exactly.
+    const int dx = shift[0];
+    const int dy = shift[1];
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, source);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+    glBlitFramebuffer(std::max(dx, 0), std::max(dy, 0), width + std::min(dx, 0), height + std::min(dy, 0),
+                      std::max(-dx, 0), std::max(-dy, 0), width - std::max(dx, 0), height - std::max(dy, 0),
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void draw_exposed_strips(int width, int height, const int shift[2])
+{
+    // The column strip first, then the row strip beside it, so the corner
+    // is not iterated twice.
+    const int dx = shift[0];
+    const int dy = shift[1];
+    const int column_x = dx > 0 ? width - dx : 0;
+    const int row_y = dy > 0 ? height - dy : 0;
+    const int row_x = dx < 0 ? -dx : 0;
+
+    glEnable(GL_SCISSOR_TEST);
+    if (dx != 0) {
+        glScissor(column_x, 0, std::abs(dx), height);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)0);
+    }
+    if (dy != 0) {
+        glScissor(row_x, row_y, width - std::abs(dx), std::abs(dy));
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)0);
+    }
+    glDisable(GL_SCISSOR_TEST);
+}
+
+void upload_orbit(GLuint orbit_buffer, const ReferenceOrbit& orbit)
+{
+    // Doubles go as pairs of 32-bit halves, put back together in the shader
+    // with packDouble2x32.
+    std::vector<double> texels;
+    texels.reserve(orbit.x.size() * 2);
+    for (int n = 0; n < orbit.length(); ++n) {
+        texels.push_back(orbit.x[n]);
+        texels.push_back(orbit.y[n]);
+    }
+
+    glBindBuffer(GL_TEXTURE_BUFFER, orbit_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, texels.size() * sizeof(double), texels.data(), GL_STATIC_DRAW);
+}
+
+void upload_bla(GLuint program, GLuint bla_buffer, const BlaTable<double>& bla)
+{
+    // Level 0 steps are single iterations, the shader computes those
+    // exactly. Each step is 3 texels of 2 doubles: A, B, (r^2, length).
+    static constexpr int max_levels = 32;
+    int offsets[max_levels] = {};
+    int counts[max_levels] = {};
+    std::vector<double> texels;
+    const int levels = std::min(bla.level_count(), max_levels);
+    for (int k = 1; k < levels; ++k) {
+        offsets[k] = static_cast<int>(texels.size() / 6);
+        counts[k] = static_cast<int>(bla.level(k).size());
+        for (const BlaStep<double>& step : bla.level(k)) {
+            const double values[6] = {step.ax, step.ay, step.bx, step.by,
+                                      step.r2, static_cast<double>(step.length)};
+            texels.insert(texels.end(), values, values + 6);
+        }
+    }
+
+    glBindBuffer(GL_TEXTURE_BUFFER, bla_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, texels.size() * sizeof(double), texels.data(), GL_STATIC_DRAW);
+
+    glUseProgram(program);
+    set_uniform_1i(program, "u_bla_levels", texels.empty() ? 0 : levels);
+    set_uniform_1iv(program, "u_bla_offset", max_levels, offsets);
+    set_uniform_1iv(program, "u_bla_count", max_levels, counts);
+}
+
+void set_uniform_1i(GLuint program, const char* uniform_name, int value)
+{
+    GLint uniform_location = glGetUniformLocation(program, uniform_name);
+    if (uniform_location == -1) {
+        std::cout << "Unable to locate uniform " << uniform_name << std::endl;
+        return;
+    }
+
+    glUniform1i(uniform_location, value);
+}
+
+void set_uniform_1iv(GLuint program, const char* uniform_name, int count, const int* values)
+{
+    GLint uniform_location = glGetUniformLocation(program, uniform_name);
+    if (uniform_location == -1) {
+        std::cout << "Unable to locate uniform " << uniform_name << std::endl;
+        return;
+    }
+
+    glUniform1iv(uniform_location, count, values);
+}
+
+void set_uniform_2i(GLuint program, const char* uniform_name, int x, int y)
+{
+    GLint uniform_location = glGetUniformLocation(program, uniform_name);
+    if (uniform_location == -1) {
+        std::cout << "Unable to locate uniform " << uniform_name << std::endl;
+        return;
+    }
+
+    glUniform2i(uniform_location, x, y);
 }
 
 void set_uniform_1f(GLuint program, const char* uniform_name, float value)
@@ -270,3 +1053,25 @@ void set_uniform_2f(GLuint program, const char* uniform_name, float x, float y)
 
     glUniform2f(uniform_location, x, y);
 }
+
+void set_uniform_1d(GLuint program, const char* uniform_name, double value)
+{
+    GLint uniform_location = glGetUniformLocation(program, uniform_name);
+    if (uniform_location == -1) {
+        std::cout << "Unable to locate uniform " << uniform_name << std::endl;
+        return;
+    }
+
+    glUniform1d(uniform_location, value);
+}
+
+void set_uniform_2d(GLuint program, const char* uniform_name, double x, double y)
+{
+    GLint uniform_location = glGetUniformLocation(program, uniform_name);
+    if (uniform_location == -1) {
+        std::cout << "Unable to locate uniform " << uniform_name << std::endl;
+        return;
+    }
+
+    glUniform2d(uniform_location, x, y);
+}
@@ -0,0 +1,372 @@
+#include "perturbation.h"
+
+#include <chrono>
+#include <cmath>
+#include <mutex>
+
+void compute_reference_orbit(const BigFixed& cx, const BigFixed& cy, int max_iter,
+                             int precision_bits, ReferenceOrbit& orbit)
+{
+    orbit.center[0] = cx;
+    orbit.center[1] = cy;
+    orbit.center[0].set_precision(precision_bits);
+    orbit.center[1].set_precision(precision_bits);
+    orbit.precision_bits = precision_bits;
+    orbit.max_iter = max_iter;
+    orbit.x.assign(1, 0.0);
+    orbit.y.assign(1, 0.0);
+
+    BigFixed zx = orbit.center[0];
+    BigFixed zy = orbit.center[1];
+    for (int i = 0; i <= max_iter; ++i) {
+        const double x = zx.to_double();
+        const double y = zy.to_double();
+        orbit.x.push_back(x);
+        orbit.y.push_back(y);
+
+        // The reference may escape, pixels then rebase at the end of it.
+        if (x * x + y * y > 4.0)
+            break;
+
+        // Zn+1 = Zn^2 + C
+        const BigFixed xx = zx * zx;
+        const BigFixed yy = zy * zy;
+        const BigFixed xy = zx * zy;
+        zx = xx - yy + orbit.center[0];
+        zy = xy + xy + orbit.center[1];
+    }
+}
+
+FloatExp max_pixel_offset(const View& view)
+{
+    const double ratio = static_cast<double>(view.width) / view.height;
+    return FloatExp(std::sqrt(ratio * ratio + 1.0)) / view.zoom;
+}
+
+bool needs_floatexp(const View& view)
+{
+    // Steps of long BLA runs multiply offsets with factors as large as the
+    // zoom, keep well clear of the 2^-1022 limit.
+    return max_pixel_offset(view).log2() < -960.0;
+}
+
+// Where z = Z_m + dz goes after an iteration: on, out of the escape radius,
+// or back to the start of the orbit.
+enum class OrbitCheck { Continue, Escaped, Rebase };
+
+static inline OrbitCheck check_orbit(const ReferenceOrbit& orbit, int m, double dx, double dy,
+                                     double& zx, double& zy, PerturbationStats& stats)
+{
+    // z itself is back in the range of double.
+    zx = orbit.x[m] + dx;
+    zy = orbit.y[m] + dy;
+    const double z2 = zx * zx + zy * zy;
+    if (z2 > 4.0)
+        return OrbitCheck::Escaped;
+
+    // Pauldelbrot: z much smaller than Z means dz cancelled Z and lost
+    // its precision.
+    const double ref2 = orbit.x[m] * orbit.x[m] + orbit.y[m] * orbit.y[m];
+    const bool glitch = z2 < 1e-6 * ref2;
+    if (glitch)
+        ++stats.glitches;
+
+    // Continue from z itself, against the start of the orbit.
+    if (glitch || z2 < dx * dx + dy * dy || m == orbit.length() - 1) {
+        ++stats.rebases;
+        return OrbitCheck::Rebase;
+    }
+    return OrbitCheck::Continue;
+}
+
+template <typename T>
+int perturbed_escape(const ReferenceOrbit& orbit, const BlaTable<T>* bla,
+                     T dcx, T dcy, int max_iter, PerturbationStats& stats)
+{
+    const double* ref_x = orbit.x.data();
+    const double* ref_y = orbit.y.data();
+
+    // z_1 = c, so dz_1 = dc.
+    T dx = dcx;
+    T dy = dcy;
+    int m = 1;
+    int i = 0;
+    while (i < max_iter) {
+        const BlaStep<T>* step = bla ? bla->lookup(m, dx * dx + dy * dy, max_iter - i) : nullptr;
+        if (step) {
+            // dz = A dz + B dc
+            const T nx = step->ax * dx - step->ay * dy + step->bx * dcx - step->by * dcy;
+            const T ny = step->ax * dy + step->ay * dx + step->bx * dcy + step->by * dcx;
+            dx = nx;
+            dy = ny;
+            m += step->length;
+            i += step->length;
+            ++stats.bla_steps;
+            stats.bla_iterations += step->length;
+        }
+        else {
+            // dz = (2 Z + dz) dz + dc
+            const T ax = T(2.0 * ref_x[m]) + dx;
+            const T ay = T(2.0 * ref_y[m]) + dy;
+            const T nx = ax * dx - ay * dy + dcx;
+            const T ny = ax * dy + ay * dx + dcy;
+            dx = nx;
+            dy = ny;
+            ++m;
+            ++i;
+        }
+
+        double zx, zy;
+        const OrbitCheck check = check_orbit(orbit, m, to_double(dx), to_double(dy), zx, zy, stats);
+        if (check == OrbitCheck::Escaped)
+            return i - 1;
+        if (check == OrbitCheck::Rebase) {
+            dx = zx;
+            dy = zy;
+            m = 0;
+        }
+    }
+
+    return max_iter;
+}
+
+// Same iteration with dz a ComplexFloatExp, normalized once per step.
+template <>
+int perturbed_escape(const ReferenceOrbit& orbit, const BlaTable<FloatExp>* bla,
+                     FloatExp dcx, FloatExp dcy, int max_iter, PerturbationStats& stats)
+{
+    const double* ref_x = orbit.x.data();
+    const double* ref_y = orbit.y.data();
+
+    const ComplexFloatExp dc(dcx, dcy);
+    ComplexFloatExp dz = dc;
+    int m = 1;
+    int i = 0;
+    while (i < max_iter) {
+        const BlaStep<FloatExp>* step = bla ? bla->lookup(m, dz.norm(), max_iter - i) : nullptr;
+        if (step) {
+            dz = ComplexFloatExp(step->ax, step->ay) * dz + ComplexFloatExp(step->bx, step->by) * dc;
+            m += step->length;
+            i += step->length;
+            ++stats.bla_steps;
+            stats.bla_iterations += step->length;
+        }
+        else {
+            dz = (ComplexFloatExp(2.0 * ref_x[m], 2.0 * ref_y[m]) + dz) * dz + dc;
+            ++m;
+            ++i;
+        }
+        dz.normalize();
+
+        double dx, dy, zx, zy;
+        dz.to_double(dx, dy);
+        const OrbitCheck check = check_orbit(orbit, m, dx, dy, zx, zy, stats);
+        if (check == OrbitCheck::Escaped)
+            return i - 1;
+        if (check == OrbitCheck::Rebase) {
+            dz = ComplexFloatExp(zx, zy);
+            m = 0;
+        }
+    }
+
+    return max_iter;
+}
+
+template int perturbed_escape(const ReferenceOrbit&, const BlaTable<double>*,
+                              double, double, int, PerturbationStats&);
+
+// BigFixed rounded to the delta type.
+static double to_delta(const BigFixed& value, double)
+{
+    return value.to_double();
+}
+
+static FloatExp to_delta(const BigFixed& value, FloatExp)
+{
+    return value.to_floatexp();
+}
+
+// Distance between pixel centers in C, in the delta type.
+static double pixel_size(const View& view, double)
+{
+    return 2.0 / (view.height * view.zoom.to_double());
+}
+
+static FloatExp pixel_size(const View& view, FloatExp)
+{
+    return FloatExp(2.0) / (FloatExp(view.height) * view.zoom);
+}
+
+// Pixel offsets from the reference per column and per row of [y0, y0 + rows),
+// in the delta type. The view may be centered off the reference, and samples
+// off the pixel centers (see RenderOptions::column_offset).
+template <typename T>
+static void pixel_offsets(const View& view, const ReferenceOrbit& orbit, int y0, int rows,
+                          const RenderOptions& options, std::vector<T>& dcx, std::vector<T>& dcy)
+{
+    dcx.resize(view.width);
+    dcy.resize(rows);
+    T unused;
+    for (int x = 0; x < view.width; ++x)
+        pixel_to_offset(view, x, 0, dcx[x], unused);
+    for (int y = 0; y < rows; ++y)
+        pixel_to_offset(view, 0, y0 + y, unused, dcy[y]);
+
+    // Zero for views centered on the reference, adding it changes nothing.
+    const T center_x = to_delta(view.center[0] - orbit.center[0], T());
+    const T center_y = to_delta(view.center[1] - orbit.center[1], T());
+    for (T& dc : dcx)
+        dc += center_x;
+    for (T& dc : dcy)
+        dc += center_y;
+
+    const T pixel = pixel_size(view, T());
+    if (options.column_offset) {
+        for (int x = 0; x < view.width; ++x)
+            dcx[x] += T(options.column_offset[x]) * pixel;
+    }
+    if (options.row_offset) {
+        for (int y = 0; y < rows; ++y)
+            dcy[y] += T(options.row_offset[y]) * pixel;
+    }
+}
+
+static const BlaTable<double>& bla_table(const PerturbationReference& reference, double)
+{
+    return reference.bla;
+}
+
+static const BlaTable<FloatExp>& bla_table(const PerturbationReference& reference, FloatExp)
+{
+    return reference.bla_floatexp;
+}
+
+template <typename T>
+static void render_deltas(const View& view, const PerturbationReference& reference, int y0,
+                          int rows, IterBuffer& iters, const RenderOptions& options,
+                          SchedulerStats* stats, PerturbationStats& total,
+                          RenderStats& render_stats)
+{
+    const ReferenceOrbit& orbit = reference.orbit;
+    const BlaTable<T>& bla = bla_table(reference, T());
+    const bool use_bla = options.bla && bla.level_count() > 0;
+
+    std::vector<T> dcx;
+    std::vector<T> dcy;
+    pixel_offsets(view, orbit, y0, rows, options, dcx, dcy);
+
+    std::mutex stats_mutex;
+    run_tiles(view.width, rows, options.tile_size, options.threads,
+              [&](const Tile& tile) {
+                  PerturbationStats local;
+                  const PixelKernel pixels = [&](const int* x, const int* y, int count, int* iter) {
+                      for (int i = 0; i < count; ++i)
+                          iter[i] = perturbed_escape(orbit, use_bla ? &bla : nullptr, dcx[x[i]],
+                                                     dcy[y[i]], view.max_iter, local);
+                  };
+                  const long long computed =
+                      fill_tile(options.strategy, tile, view.width, pixels, iters.iter.data(),
+                                options.keep);
+
+                  std::lock_guard<std::mutex> lock(stats_mutex);
+                  render_stats.computed += computed;
+                  total.glitches += local.glitches;
+                  total.rebases += local.rebases;
+                  total.bla_steps += local.bla_steps;
+                  total.bla_iterations += local.bla_iterations;
+              },
+              stats);
+}
+
+void prepare_reference(const View& view, const RenderOptions& options,
+                       PerturbationReference& reference)
+{
+    auto start = std::chrono::steady_clock::now();
+    compute_reference_orbit(view.center[0], view.center[1], view.max_iter,
+                            precision_for_zoom(view.zoom), reference.orbit);
+    auto end = std::chrono::steady_clock::now();
+    reference.reference_seconds = std::chrono::duration<double>(end - start).count();
+
+    prepare_bla(view, options, reference);
+}
+
+// Pixels start at dz = dc. Unless a step of some length holds them there,
+// too few iterations are skipped to pay for the lookups, the spiral of
+// --verify breaks even around 1e20, with a first step of 32 iterations.
+static constexpr int BLA_MIN_FIRST_STEP = 32;
+
+template <typename T>
+static void drop_if_useless(BlaTable<T>& bla, const T& dc_max, int max_iter)
+{
+    const BlaStep<T>* first = bla.lookup(1, dc_max * dc_max, max_iter);
+    if (!first || first->length < BLA_MIN_FIRST_STEP)
+        bla = BlaTable<T>();
+}
+
+void prepare_bla(const View& view, const RenderOptions& options, PerturbationReference& reference)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    // Plain double keeps full speed wherever it does not underflow.
+    reference.floatexp = needs_floatexp(view);
+    reference.bla = BlaTable<double>();
+    reference.bla_floatexp = BlaTable<FloatExp>();
+    if (options.bla) {
+        // Pixels are as far from the reference as from the view center, plus
+        // the distance between both, plus a pixel for samples off the pixel
+        // centers.
+        const FloatExp center_x = (view.center[0] - reference.orbit.center[0]).to_floatexp();
+        const FloatExp center_y = (view.center[1] - reference.orbit.center[1]).to_floatexp();
+        FloatExp dc_max = max_pixel_offset(view) + sqrt(center_x * center_x + center_y * center_y);
+        if (options.column_offset || options.row_offset)
+            dc_max = dc_max + FloatExp(3.0) / (FloatExp(view.height) * view.zoom);
+        if (reference.floatexp) {
+            reference.bla_floatexp.build(reference.orbit, dc_max);
+            drop_if_useless(reference.bla_floatexp, dc_max, view.max_iter);
+        }
+        else {
+            reference.bla.build(reference.orbit, dc_max.to_double());
+            drop_if_useless(reference.bla, dc_max.to_double(), view.max_iter);
+        }
+    }
+    reference.bla_seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void render_perturbation_rows(const View& view, const PerturbationReference& reference, int y0,
+                              int rows, IterBuffer& iters, const RenderOptions& options,
+                              SchedulerStats* stats, PerturbationStats* perturbation_stats,
+                              RenderStats* render_stats)
+{
+    iters.width = view.width;
+    iters.height = rows;
+    iters.iter.resize(static_cast<size_t>(view.width) * rows);
+
+    PerturbationStats total;
+    RenderStats pixels;
+    pixels.pixels = static_cast<long long>(view.width) * rows;
+    total.floatexp = reference.floatexp;
+    if (total.floatexp)
+        render_deltas<FloatExp>(view, reference, y0, rows, iters, options, stats, total, pixels);
+    else
+        render_deltas<double>(view, reference, y0, rows, iters, options, stats, total, pixels);
+    if (render_stats)
+        *render_stats = pixels;
+
+    if (perturbation_stats) {
+        *perturbation_stats = total;
+        perturbation_stats->reference_seconds = reference.reference_seconds;
+        perturbation_stats->reference_length = reference.orbit.length();
+        perturbation_stats->bla_seconds = reference.bla_seconds;
+    }
+}
+
+void render_perturbation(const View& view, IterBuffer& iters, const RenderOptions& options,
+                         SchedulerStats* stats, PerturbationStats* perturbation_stats,
+                         RenderStats* render_stats)
+{
+    PerturbationReference reference;
+    prepare_reference(view, options, reference);
+    render_perturbation_rows(view, reference, 0, view.height, iters, options, stats,
+                             perturbation_stats, render_stats);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vector>
+
+#include "bigfixed.h"
+#include "bla.h"
+#include "fractal.h"
+
+// Perturbation deep zoom.
+// One reference orbit Z is computed at full precision, every pixel then only
+// iterates its small offset dz from it in double:
+//     dz_n+1 = (2 Z_n + dz_n) dz_n + dc
+// Where Z + dz gets smaller than dz the pixel has lost the reference (the
+// glitches found by the Pauldelbrot criterion), it is rebased: dz takes the
+// full value of z and restarts from the beginning of the orbit.
+// Deltas are double, or FloatExp once the pixel offsets underflow double.
+
+struct ReferenceOrbit
+{
+    BigFixed center[2];
+    int precision_bits = 0;
+    int max_iter = 0;
+
+    // Z_0 = 0, Z_1 = c, ... up to escape or max_iter + 1, rounded to double.
+    std::vector<double> x;
+    std::vector<double> y;
+
+    int length() const { return static_cast<int>(x.size()); }
+};
+
+struct PerturbationStats
+{
+    double reference_seconds = 0.0;
+    int reference_length = 0;
+    long long glitches = 0; // Pauldelbrot detections, fixed by rebasing
+    long long rebases = 0;
+
+    double bla_seconds = 0.0;     // table build time
+    long long bla_steps = 0;      // BLA steps taken
+    long long bla_iterations = 0; // iterations they covered
+
+    bool floatexp = false; // deltas past the range of double
+
+    double average_skip() const { return bla_steps ? double(bla_iterations) / bla_steps : 0.0; }
+};
+
+void compute_reference_orbit(const BigFixed& cx, const BigFixed& cy, int max_iter,
+                             int precision_bits, ReferenceOrbit& orbit);
+
+// Largest pixel offset from the view center, what a BLA table for view must
+// cover.
+FloatExp max_pixel_offset(const View& view);
+
+// Whether the pixel offsets of view underflow double, with margin for the
+// products of the BLA steps.
+bool needs_floatexp(const View& view);
+
+// Escape iteration of the point at offset dc from the reference, same
+// numbering as mandelbrot(). Iterations are skipped through bla if given.
+// Defined for T = double and FloatExp, the latter iterating dz as a
+// ComplexFloatExp.
+template <typename T>
+int perturbed_escape(const ReferenceOrbit& orbit, const BlaTable<T>* bla,
+                     T dcx, T dcy, int max_iter, PerturbationStats& stats);
+template <>
+int perturbed_escape(const ReferenceOrbit& orbit, const BlaTable<FloatExp>* bla,
+                     FloatExp dcx, FloatExp dcy, int max_iter, PerturbationStats& stats);
+
+// Reference orbit at the center of a view and the BLA table for its
+// pixels, computed once and shared by every part of the view rendered on its
+// own, like the strips of an image too large to hold.
+struct PerturbationReference
+{
+    ReferenceOrbit orbit;
+    bool floatexp = false; // deltas past the range of double, see needs_floatexp()
+    BlaTable<double> bla;  // empty without options.bla, one of both otherwise
+    BlaTable<FloatExp> bla_floatexp;
+    double reference_seconds = 0.0;
+    double bla_seconds = 0.0;
+};
+
+void prepare_reference(const View& view, const RenderOptions& options,
+                       PerturbationReference& reference);
+
+// Build the BLA table of reference again for the pixels of view, which may
+// be centered anywhere near the orbit. Views that move around one orbit,
+// such as the frames of an animation, share it this way.
+void prepare_bla(const View& view, const RenderOptions& options, PerturbationReference& reference);
+
+// Rows [y0, y0 + rows) of view around reference, into iters of
+// view.width x rows. Same pixels as those rows of render_perturbation().
+// The view center need not be the reference one, see prepare_bla().
+void render_perturbation_rows(const View& view, const PerturbationReference& reference, int y0,
+                              int rows, IterBuffer& iters,
+                              const RenderOptions& options = RenderOptions(),
+                              SchedulerStats* stats = nullptr,
+                              PerturbationStats* perturbation_stats = nullptr,
+                              RenderStats* render_stats = nullptr);
+
+// Render view around a reference orbit at its center, skipping iterations
+// with a BLA table when options.bla is set. Pixels are picked by
+// options.strategy like in render_iterations().
+void render_perturbation(const View& view, IterBuffer& iters,
+                         const RenderOptions& options = RenderOptions(),
+                         SchedulerStats* stats = nullptr,
+                         PerturbationStats* perturbation_stats = nullptr,
+                         RenderStats* render_stats = nullptr);
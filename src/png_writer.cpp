@@ -0,0 +1,304 @@
+#include "png_writer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "deflate.h"
+#include "scheduler.h"
+
+// Raw bytes per strip, enough for deflate to find its matches and for
+// every thread to get several strips of a large image.
+static constexpr size_t STRIP_BYTES = size_t(1) << 20;
+
+// Bytes held by the strips in flight, each counted three times its raw
+// size: its rows, then their filtered copy and the deflated output while a
+// thread compresses it. Two strips per thread up to this.
+static constexpr size_t IN_FLIGHT_BYTES = size_t(48) << 20;
+
+static void put_u32(uint8_t* p, uint32_t value)
+{
+    p[0] = static_cast<uint8_t>(value >> 24);
+    p[1] = static_cast<uint8_t>(value >> 16);
+    p[2] = static_cast<uint8_t>(value >> 8);
+    p[3] = static_cast<uint8_t>(value);
+}
+
+// Predictor of the Paeth filter, written so compilers need no branch.
+static int paeth(int a, int b, int c)
+{
+    const int pa = std::abs(b - c);
+    const int pb = std::abs(a - c);
+    const int pc = std::abs(a + b - 2 * c);
+    const int bc = pb <= pc ? b : c;
+    return pa <= pb && pa <= pc ? a : bc;
+}
+
+// Byte x under each filter, with a left of it, b above and c above left.
+static uint8_t filter_byte(int type, int x, int a, int b, int c)
+{
+    switch (type) {
+    case 0: return static_cast<uint8_t>(x);
+    case 1: return static_cast<uint8_t>(x - a);
+    case 2: return static_cast<uint8_t>(x - b);
+    case 3: return static_cast<uint8_t>(x - ((a + b) >> 1));
+    default: return static_cast<uint8_t>(x - paeth(a, b, c));
+    }
+}
+
+static uint32_t signed_magnitude(int value)
+{
+    return std::abs(static_cast<int8_t>(static_cast<uint8_t>(value)));
+}
+
+// Filter row into out, after its filter byte. above is the row before it.
+// The filter is the one whose bytes, as signed values, sum the lowest, the
+// usual guess of which compresses best. All are scored in one pass, the
+// first pixel has nothing on its left and is scored apart so the loop over
+// the others has no branch.
+static void filter_row(const uint8_t* row, const uint8_t* above, size_t size, uint8_t* out)
+{
+    const size_t first = std::min<size_t>(3, size);
+    uint32_t costs[5] = {};
+    for (size_t i = 0; i < first; ++i) {
+        for (int type = 0; type < 5; ++type)
+            costs[type] += signed_magnitude(filter_byte(type, row[i], 0, above[i], 0));
+    }
+    uint32_t none = 0, sub = 0, up = 0, average = 0, paeth_sum = 0;
+    for (size_t i = first; i < size; ++i) {
+        const int x = row[i];
+        const int a = row[i - 3];
+        const int b = above[i];
+        const int c = above[i - 3];
+        none += signed_magnitude(x);
+        sub += signed_magnitude(x - a);
+        up += signed_magnitude(x - b);
+        average += signed_magnitude(x - ((a + b) >> 1));
+        paeth_sum += signed_magnitude(x - paeth(a, b, c));
+    }
+    costs[0] += none;
+    costs[1] += sub;
+    costs[2] += up;
+    costs[3] += average;
+    costs[4] += paeth_sum;
+
+    const int type = static_cast<int>(std::min_element(costs, costs + 5) - costs);
+    out[0] = static_cast<uint8_t>(type);
+    for (size_t i = 0; i < first; ++i)
+        out[i + 1] = filter_byte(type, row[i], 0, above[i], 0);
+    switch (type) {
+    case 0:
+        std::copy(row + first, row + size, out + first + 1);
+        break;
+    case 1:
+        for (size_t i = first; i < size; ++i)
+            out[i + 1] = static_cast<uint8_t>(row[i] - row[i - 3]);
+        break;
+    case 2:
+        for (size_t i = first; i < size; ++i)
+            out[i + 1] = static_cast<uint8_t>(row[i] - above[i]);
+        break;
+    case 3:
+        for (size_t i = first; i < size; ++i)
+            out[i + 1] = static_cast<uint8_t>(row[i] - ((row[i - 3] + above[i]) >> 1));
+        break;
+    default:
+        for (size_t i = first; i < size; ++i)
+            out[i + 1] = static_cast<uint8_t>(row[i] - paeth(row[i - 3], above[i], above[i - 3]));
+        break;
+    }
+}
+
+PngWriter::~PngWriter()
+{
+    close();
+}
+
+bool PngWriter::open(const std::string& file, int width, int height, int threads)
+{
+    if (file_ || width <= 0 || height <= 0)
+        return false;
+    file_ = std::fopen(file.c_str(), "wb");
+    if (!file_)
+        return false;
+
+    failed_ = false;
+    width_ = width;
+    height_ = height;
+    rows_written_ = 0;
+    adler_ = 1;
+    const size_t row_bytes = static_cast<size_t>(width) * 3;
+    strip_rows_ = static_cast<int>(std::clamp<size_t>(STRIP_BYTES / row_bytes, 1, height));
+    rows_.resize(row_bytes * strip_rows_);
+    row_count_ = 0;
+    last_row_.assign(row_bytes, 0); // PNG filters see zeros above the top row
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    failed_ |= std::fwrite(signature, 1, sizeof(signature), file_) != sizeof(signature);
+    uint8_t header[13] = {};
+    put_u32(header, static_cast<uint32_t>(width));
+    put_u32(header + 4, static_cast<uint32_t>(height));
+    header[8] = 8; // bits per channel
+    header[9] = 2; // RGB
+    write_chunk("IHDR", header, sizeof(header));
+
+    const int thread_count = threads > 0 ? threads : default_thread_count();
+    max_in_flight_ = std::max<size_t>(std::min(static_cast<size_t>(thread_count) * 2,
+                                               IN_FLIGHT_BYTES / (3 * row_bytes * strip_rows_)),
+                                      1);
+    stopping_ = false;
+    for (int i = 0; i < thread_count; ++i)
+        threads_.emplace_back(&PngWriter::compress_strips, this);
+    return !failed_;
+}
+
+bool PngWriter::write_rows(const unsigned char* rgb, int rows)
+{
+    if (!file_)
+        return false;
+    if (rows < 0 || rows > height_ - rows_written_ - row_count_) {
+        failed_ = true;
+        return false;
+    }
+
+    const size_t row_bytes = static_cast<size_t>(width_) * 3;
+    for (int y = 0; y < rows; ++y) {
+        std::memcpy(&rows_[row_count_ * row_bytes], rgb + y * row_bytes, row_bytes);
+        if (++row_count_ == strip_rows_ || rows_written_ + row_count_ == height_)
+            submit();
+    }
+    return !failed_;
+}
+
+void PngWriter::submit()
+{
+    const size_t row_bytes = static_cast<size_t>(width_) * 3;
+    auto strip = std::make_unique<Strip>();
+    strip->pixels.assign(rows_.begin(), rows_.begin() + row_count_ * row_bytes);
+    strip->previous = last_row_;
+    strip->rows = row_count_;
+    strip->first = rows_written_ == 0;
+    strip->last = rows_written_ + row_count_ == height_;
+    std::copy(strip->pixels.end() - row_bytes, strip->pixels.end(), last_row_.begin());
+    rows_written_ += row_count_;
+    row_count_ = 0;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    write_done(lock);
+    while (in_flight_.size() >= max_in_flight_) {
+        strip_done_.wait(lock);
+        write_done(lock);
+    }
+    queue_.push_back(strip.get());
+    in_flight_.push_back(std::move(strip));
+    work_.notify_one();
+}
+
+void PngWriter::write_done(std::unique_lock<std::mutex>& lock)
+{
+    while (!in_flight_.empty() && in_flight_.front()->done) {
+        std::unique_ptr<Strip> strip = std::move(in_flight_.front());
+        in_flight_.pop_front();
+        // Only this thread writes, the workers go on meanwhile.
+        lock.unlock();
+        write_strip(*strip);
+        lock.lock();
+    }
+}
+
+void PngWriter::compress_strips()
+{
+    for (;;) {
+        Strip* strip;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            work_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty())
+                return;
+            strip = queue_.front();
+            queue_.pop_front();
+        }
+
+        const size_t row_bytes = static_cast<size_t>(width_) * 3;
+        std::vector<uint8_t> filtered(strip->rows * (row_bytes + 1));
+        for (int y = 0; y < strip->rows; ++y) {
+            const uint8_t* row = &strip->pixels[y * row_bytes];
+            const uint8_t* above = y > 0 ? row - row_bytes : strip->previous.data();
+            filter_row(row, above, row_bytes, &filtered[y * (row_bytes + 1)]);
+        }
+        strip->pixels = std::vector<uint8_t>();
+        strip->previous = std::vector<uint8_t>();
+
+        if (strip->first)
+            strip->compressed = {0x78, 0x01}; // zlib header: deflate, 32 KB window
+        deflate_piece(filtered.data(), filtered.size(), strip->last, strip->compressed);
+        strip->adler = adler32(filtered.data(), filtered.size());
+        strip->filtered_size = filtered.size();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            strip->done = true;
+        }
+        strip_done_.notify_all();
+    }
+}
+
+void PngWriter::write_strip(Strip& strip)
+{
+    adler_ = adler32_combine(adler_, strip.adler, strip.filtered_size);
+    if (strip.last) {
+        uint8_t trailer[4];
+        put_u32(trailer, adler_);
+        strip.compressed.insert(strip.compressed.end(), trailer, trailer + 4);
+    }
+    write_chunk("IDAT", strip.compressed.data(), strip.compressed.size());
+}
+
+void PngWriter::write_chunk(const char* type, const uint8_t* data, size_t size)
+{
+    uint8_t head[8];
+    put_u32(head, static_cast<uint32_t>(size));
+    std::memcpy(head + 4, type, 4);
+    uint8_t crc[4];
+    put_u32(crc, crc32(data, size, crc32(head + 4, 4)));
+
+    failed_ |= std::fwrite(head, 1, sizeof(head), file_) != sizeof(head);
+    failed_ |= size > 0 && std::fwrite(data, 1, size, file_) != size;
+    failed_ |= std::fwrite(crc, 1, sizeof(crc), file_) != sizeof(crc);
+}
+
+bool PngWriter::close()
+{
+    if (!file_)
+        return false;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!in_flight_.empty()) {
+            write_done(lock);
+            if (!in_flight_.empty())
+                strip_done_.wait(lock);
+        }
+        stopping_ = true;
+    }
+    work_.notify_all();
+    for (std::thread& thread : threads_)
+        thread.join();
+    threads_.clear();
+
+    // Without all rows the zlib stream has no end, the file is not valid.
+    failed_ |= rows_written_ != height_ || row_count_ != 0;
+    write_chunk("IEND", nullptr, 0);
+    failed_ |= std::fclose(file_) != 0;
+    file_ = nullptr;
+    return !failed_;
+}
+
+bool write_png(const std::string& file, const Image& image, int threads)
+{
+    PngWriter writer;
+    if (!writer.open(file, image.width, image.height, threads))
+        return false;
+    const bool written = writer.write_rows(image.rgb.data(), image.height);
+    return writer.close() && written;
+}
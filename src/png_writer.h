@@ -0,0 +1,93 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fractal.h"
+
+// PNG writer for images too large for stbi_write_png, which compresses the
+// whole image at once on one thread.
+// Rows are taken a few at a time and cut into strips. Each strip is filtered
+// and deflated on its own by a pool of threads (see deflate_piece()), and the
+// pieces go to the file in order as IDAT chunks of one zlib stream. Only the
+// strips in flight are held, never the whole image raw or compressed: two
+// per thread, within about 48 MB whatever the thread count.
+
+class PngWriter
+{
+public:
+    PngWriter() = default;
+    ~PngWriter();
+    PngWriter(const PngWriter&) = delete;
+    PngWriter& operator=(const PngWriter&) = delete;
+
+    // Start an 8 bit RGB image of width x height pixels in file. threads 0
+    // for one per hardware thread.
+    bool open(const std::string& file, int width, int height, int threads = 0);
+
+    // Next rows of the image, top of the PNG first, 3 bytes per pixel.
+    // Blocks while too many strips wait to be compressed.
+    bool write_rows(const unsigned char* rgb, int rows);
+
+    // Write what is left and the end of the file. False if anything failed
+    // to be written or rows are missing.
+    bool close();
+
+    // Rows per strip, writing this many at once saves a copy.
+    int strip_rows() const { return strip_rows_; }
+
+private:
+    struct Strip
+    {
+        std::vector<uint8_t> pixels;   // rows as given, dropped once compressed
+        std::vector<uint8_t> previous; // row above the first one
+        int rows = 0;
+        bool first = false;
+        bool last = false;
+
+        // Deflated filtered rows, and the Adler-32 and size of what went in.
+        std::vector<uint8_t> compressed;
+        uint32_t adler = 1;
+        size_t filtered_size = 0;
+        bool done = false;
+    };
+
+    void submit();
+    // Write the strips done at the front of in_flight_, mutex_ held by lock.
+    void write_done(std::unique_lock<std::mutex>& lock);
+    void compress_strips();
+    void write_strip(Strip& strip);
+    void write_chunk(const char* type, const uint8_t* data, size_t size);
+
+    std::FILE* file_ = nullptr;
+    bool failed_ = false;
+    int width_ = 0;
+    int height_ = 0;
+    int rows_written_ = 0;
+    int strip_rows_ = 0;
+    size_t max_in_flight_ = 0;
+    uint32_t adler_ = 1; // of the stream written so far
+
+    // Rows gathered for the next strip, unfiltered.
+    std::vector<uint8_t> rows_;
+    int row_count_ = 0;
+    std::vector<uint8_t> last_row_;
+
+    std::mutex mutex_;
+    std::condition_variable strip_done_;
+    std::condition_variable work_;
+    std::deque<std::unique_ptr<Strip>> in_flight_; // in image order
+    std::deque<Strip*> queue_;                     // not taken by a thread yet
+    bool stopping_ = false;
+    std::vector<std::thread> threads_;
+};
+
+// Whole image in one call, rows as stored in image.
+bool write_png(const std::string& file, const Image& image, int threads = 0);
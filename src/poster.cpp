@@ -0,0 +1,237 @@
+#include "poster.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include "png_writer.h"
+
+namespace {
+
+// Tiles drawn or read back at the same time. One is drawn while the GPU
+// still works through the one before and the oldest is copied out.
+constexpr int TILES_IN_FLIGHT = 3;
+
+struct TileSlot
+{
+    GLuint iteration_framebuffer = 0;
+    GLuint iteration_texture = 0;
+    GLuint color_framebuffer = 0;
+    GLuint color_renderbuffer = 0;
+    GLuint pixel_buffer = 0;
+    GLsync fence = nullptr;
+    int tile = -1; // index of the tile being read back
+};
+
+struct TileGrid
+{
+    int width = 0; // of the image
+    int height = 0;
+    int tile_width = 0;
+    int tile_height = 0;
+    int columns = 0;
+    int rows = 0;
+
+    int count() const { return columns * rows; }
+    int x0(int tile) const { return tile % columns * tile_width; }
+    int y0(int tile) const { return tile / columns * tile_height; }
+    int width_of(int tile) const { return std::min(tile_width, width - x0(tile)); }
+    int height_of(int tile) const { return std::min(tile_height, height - y0(tile)); }
+    bool ends_band(int tile) const { return tile % columns == columns - 1; }
+};
+
+void create_slot(int width, int height, TileSlot& slot)
+{
+    // Same format as the iteration targets of the window.
+    glGenTextures(1, &slot.iteration_texture);
+    glBindTexture(GL_TEXTURE_2D, slot.iteration_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenFramebuffers(1, &slot.iteration_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, slot.iteration_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           slot.iteration_texture, 0);
+
+    glGenRenderbuffers(1, &slot.color_renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, slot.color_renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glGenFramebuffers(1, &slot.color_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, slot.color_framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER,
+                              slot.color_renderbuffer);
+
+    glGenBuffers(1, &slot.pixel_buffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pixel_buffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(width) * height * 3, nullptr,
+                 GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void delete_slot(TileSlot& slot)
+{
+    if (slot.fence)
+        glDeleteSync(slot.fence);
+    glDeleteFramebuffers(1, &slot.iteration_framebuffer);
+    glDeleteTextures(1, &slot.iteration_texture);
+    glDeleteFramebuffers(1, &slot.color_framebuffer);
+    glDeleteRenderbuffers(1, &slot.color_renderbuffer);
+    glDeleteBuffers(1, &slot.pixel_buffer);
+    slot = TileSlot();
+}
+
+// The part of view that tile covers: same pixel size, centered on the tile.
+View tile_view(const View& view, const TileGrid& grid, int tile)
+{
+    const int width = grid.width_of(tile);
+    const int height = grid.height_of(tile);
+    const FloatExp pixel = FloatExp(2.0) / (FloatExp(view.height) * view.zoom);
+    const double offset[2] = {grid.x0(tile) + width / 2.0 - view.width / 2.0,
+                              grid.y0(tile) + height / 2.0 - view.height / 2.0};
+
+    View part = view;
+    part.width = width;
+    part.height = height;
+    part.zoom = view.zoom * FloatExp(static_cast<double>(view.height) / height);
+    for (int k = 0; k < 2; ++k)
+        part.center[k] = view.center[k] + BigFixed((pixel * FloatExp(offset[k])).to_double());
+    return part;
+}
+
+void draw_tile(const View& view, const TileGrid& grid, int tile, const PosterPasses& passes,
+               TileSlot& slot)
+{
+    const int width = grid.width_of(tile);
+    const int height = grid.height_of(tile);
+    glViewport(0, 0, width, height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, slot.iteration_framebuffer);
+    passes.iterate(tile_view(view, grid, tile));
+    glBindFramebuffer(GL_FRAMEBUFFER, slot.color_framebuffer);
+    passes.colorize(slot.iteration_texture);
+
+    // Returns at once, the copy is only waited for once the slot comes
+    // round again.
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pixel_buffer);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.tile = tile;
+}
+
+// Wait for the tile of slot and copy it into band, the rows of its band of
+// tiles. Returns false if the GPU or the mapping failed.
+bool read_tile(const TileGrid& grid, TileSlot& slot, std::vector<unsigned char>& band,
+               double& wait_seconds)
+{
+    const auto start = std::chrono::steady_clock::now();
+    GLenum status;
+    do {
+        status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);
+    } while (status == GL_TIMEOUT_EXPIRED);
+    wait_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+    if (status == GL_WAIT_FAILED)
+        return false;
+
+    const int x0 = grid.x0(slot.tile);
+    const size_t row_bytes = static_cast<size_t>(grid.width_of(slot.tile)) * 3;
+    const size_t band_row_bytes = static_cast<size_t>(grid.width) * 3;
+    const int height = grid.height_of(slot.tile);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pixel_buffer);
+    const auto* pixels = static_cast<const unsigned char*>(
+        glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, row_bytes * height, GL_MAP_READ_BIT));
+    if (pixels) {
+        for (int y = 0; y < height; ++y)
+            std::memcpy(&band[y * band_row_bytes + x0 * 3], pixels + y * row_bytes, row_bytes);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return pixels != nullptr;
+}
+
+} // namespace
+
+bool render_poster(const View& view, const PosterPasses& passes, const std::string& file,
+                   int max_tile, PosterStats* stats)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    // Largest tile every object of a slot can have.
+    GLint viewport_dims[2] = {};
+    GLint texture_size = 0;
+    GLint renderbuffer_size = 0;
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, viewport_dims);
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &texture_size);
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &renderbuffer_size);
+    const int limit = std::min({max_tile, static_cast<int>(texture_size),
+                                static_cast<int>(renderbuffer_size)});
+
+    TileGrid grid;
+    grid.width = view.width;
+    grid.height = view.height;
+    grid.tile_width = std::min({limit, static_cast<int>(viewport_dims[0]), view.width});
+    grid.tile_height = std::min({limit, static_cast<int>(viewport_dims[1]), view.height});
+    if (grid.tile_width <= 0 || grid.tile_height <= 0)
+        return false;
+    grid.columns = (view.width + grid.tile_width - 1) / grid.tile_width;
+    grid.rows = (view.height + grid.tile_height - 1) / grid.tile_height;
+
+    PngWriter png;
+    if (!png.open(file, view.width, view.height))
+        return false;
+
+    GLint previous_framebuffer = 0;
+    GLint previous_viewport[4] = {};
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_framebuffer);
+    glGetIntegerv(GL_VIEWPORT, previous_viewport);
+
+    TileSlot slots[TILES_IN_FLIGHT];
+    for (TileSlot& slot : slots)
+        create_slot(grid.tile_width, grid.tile_height, slot);
+
+    std::vector<unsigned char> band(static_cast<size_t>(view.width) * grid.tile_height * 3);
+    double wait_seconds = 0.0;
+    bool ok = true;
+
+    // Tiles go in order, so the one read back out of a slot always comes
+    // before those still in flight. A band is saved once its last tile is in.
+    auto retire = [&](TileSlot& slot) {
+        ok = read_tile(grid, slot, band, wait_seconds) && ok;
+        if (ok && grid.ends_band(slot.tile))
+            ok = png.write_rows(band.data(), grid.height_of(slot.tile));
+        slot.tile = -1;
+    };
+    for (int tile = 0; ok && tile < grid.count(); ++tile) {
+        TileSlot& slot = slots[tile % TILES_IN_FLIGHT];
+        if (slot.fence)
+            retire(slot);
+        draw_tile(view, grid, tile, passes, slot);
+    }
+    for (int k = 0; k < TILES_IN_FLIGHT; ++k) {
+        TileSlot& slot = slots[(grid.count() + k) % TILES_IN_FLIGHT];
+        if (slot.fence)
+            retire(slot);
+    }
+
+    for (TileSlot& slot : slots)
+        delete_slot(slot);
+    glBindFramebuffer(GL_FRAMEBUFFER, previous_framebuffer);
+    glViewport(previous_viewport[0], previous_viewport[1], previous_viewport[2],
+               previous_viewport[3]);
+    ok = png.close() && ok;
+
+    if (stats) {
+        stats->tiles = grid.count();
+        stats->tile_width = grid.tile_width;
+        stats->tile_height = grid.tile_height;
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats->wait_seconds = wait_seconds;
+    }
+    return ok;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "glad/glad.h"
+
+#include "fractal.h"
+
+// Offscreen render of a view at any size, past the largest viewport,
+// texture and renderbuffer the GL implementation has.
+// The image is cut into tiles, each drawn as a view of its own: the center
+// moved onto the tile and the zoom scaled so that pixels keep the size they
+// have in the whole image. A few tiles are in flight at once, each with its
+// own framebuffers and pixel buffer object, so the GPU draws the next tile
+// while the ones before are read back. Tiles are put together a band of
+// rows at a time and streamed to a PngWriter, the image is never held whole.
+// Needs a current GL context, none of it depends on a window.
+
+struct PosterPasses
+{
+    // Iterate view into the bound framebuffer, view.width x view.height.
+    std::function<void(const View& view)> iterate;
+    // Color the iterations left in texture into the bound framebuffer.
+    std::function<void(GLuint iterations)> colorize;
+};
+
+struct PosterStats
+{
+    int tiles = 0;
+    int tile_width = 0;
+    int tile_height = 0;
+    double seconds = 0.0;
+    double wait_seconds = 0.0; // blocked on tiles the GPU had not finished
+};
+
+// Render view into a PNG file, in tiles at most max_tile pixels on a side.
+// Rows are bottom to top like the captures of the window.
+bool render_poster(const View& view, const PosterPasses& passes, const std::string& file,
+                   int max_tile = 2048, PosterStats* stats = nullptr);
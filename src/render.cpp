@@ -0,0 +1,1080 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "animation.h"
+#include "fractal.h"
+#include "json.h"
+#include "kernel.h"
+#include "perturbation.h"
+#include "png_writer.h"
+#include "tile_cache.h"
+#include "tile_store.h"
+#include "y4m_writer.h"
+
+// Headless renderer: computes one view on the CPU and saves it as PNG.
+// Does not need a GPU nor a window, so it runs on render nodes.
+
+static void print_usage()
+{
+    std::cout << "Usage: render [options] [output.png | output.y4m | -]\n"
+              << "  --center X Y     center of the view (default 0 0)\n"
+              << "  --zoom Z         zoom factor (default 1)\n"
+              << "  --size W H       image size in pixels (default 1280 960)\n"
+              << "  --max-iter N     iteration limit (default 200)\n"
+              << "  --threads N      worker threads (default one per hardware thread)\n"
+              << "  --tile N         tile size in pixels for the scheduler (default 64)\n"
+              << "  --isa NAME       scalar, sse2, avx2 or avx512 (default widest supported)\n"
+              << "  --no-bla         iterate every step of deep zooms, without BLA\n"
+              << "  --strategy NAME  brute-force, subdivision or boundary-trace\n"
+              << "                   (default brute-force)\n"
+              << "  --tile-cache MB  render through a tile cache of MB megabytes, the view is\n"
+              << "                   moved to the nearest tile grid. The cache only lasts\n"
+              << "                   for this run: tiles are reused between the jobs of\n"
+              << "                   --batch, or between runs with --tile-store\n"
+              << "  --tile-store FILE  keep the tiles of the cache in a pack file too, and\n"
+              << "                   reuse those already there (implies --tile-cache 256)\n"
+              << "  --compact-store FILE  rewrite a tile pack without duplicates and exit\n"
+              << "  --palette N      palette, 0 to " << PALETTE_COUNT - 1 << " as in zoom (default 0)\n"
+              << "  --stream         render and save a band of rows at a time, in constant\n"
+              << "                   memory (default past 256 Mpixels)\n"
+              << "  --batch FILE     render every job of a JSON job file, several at once\n"
+              << "  --jobs N         jobs of --batch rendered at once (default one per thread)\n"
+              << "  --animate N      render N frames zooming from the view to the end keyframe\n"
+              << "                   as a Y4M video, to standard output for - (the default)\n"
+              << "  --end-center X Y  center of the end keyframe (default the view center)\n"
+              << "  --end-zoom Z     zoom of the end keyframe (default the view zoom)\n"
+              << "  --fps N          frame rate of the video (default 30)\n"
+              << "  --reuse E        seed frames with counts of the frame before computed within\n"
+              << "                   E pixels of the pixel center, up to 1, 0 to compute every\n"
+              << "                   pixel (default 0.5)\n"
+              << "  --stats          print per-thread scheduler statistics\n"
+              << "  --bench          report throughput of every kernel instead of saving\n"
+              << "  --bench-kernels  time each kernel specialization against runtime branching\n"
+              << "  --verify         compare every strategy with brute force, BLA with plain\n"
+              << "                   perturbation, on reference views\n";
+}
+
+static bool parse_isa(const std::string& name, Isa& isa)
+{
+    for (int i = 0; i < ISA_COUNT; ++i) {
+        std::string lower = isa_name(static_cast<Isa>(i));
+        lower.erase(std::remove(lower.begin(), lower.end(), '-'), lower.end());
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        if (lower == name) {
+            isa = static_cast<Isa>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_strategy(const std::string& name, Strategy& strategy)
+{
+    for (int i = 0; i < STRATEGY_COUNT; ++i) {
+        if (name == strategy_name(static_cast<Strategy>(i))) {
+            strategy = static_cast<Strategy>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void print_stats(const SchedulerStats& stats)
+{
+    std::cout << stats.tiles << " tiles on " << stats.threads << " threads in "
+              << stats.wall_seconds * 1e3 << " ms, efficiency "
+              << stats.efficiency() * 100.0 << "%\n";
+    for (int i = 0; i < stats.threads; ++i) {
+        std::cout << "  thread " << i << ": " << stats.tiles_done[i] << " tiles, "
+                  << stats.steals[i] << " steals, busy "
+                  << stats.busy_seconds[i] * 1e3 << " ms\n";
+    }
+}
+
+static void print_cache_stats(const TileCacheStats& stats)
+{
+    std::cout << "Tile cache: " << stats.hits << " hits, " << stats.disk_hits << " from disk, "
+              << stats.misses << " misses ("
+              << stats.hit_rate() * 100.0 << "% hit rate), " << stats.tiles << " tiles in "
+              << stats.bytes / (1024.0 * 1024.0) << " of " << stats.budget / (1024.0 * 1024.0)
+              << " MB, " << stats.evictions << " evicted\n";
+}
+
+// Render view with each supported instruction set and print its throughput
+// in millions of iterations per second. Only iterations of escaping pixels
+// count, over the time of the whole view: a lower bound where the view has
+// interior pixels, whose work is not known.
+static int run_bench(const View& view)
+{
+    IterBuffer reference;
+    double scalar_rate = 0.0;
+
+    for (int i = 0; i < ISA_COUNT; ++i) {
+        const Isa isa = static_cast<Isa>(i);
+        if (!isa_supported(isa)) {
+            std::cout << isa_name(isa) << ": not supported\n";
+            continue;
+        }
+
+        IterBuffer iters;
+        const auto start = std::chrono::steady_clock::now();
+        render_iterations(view, iters, isa);
+        const auto end = std::chrono::steady_clock::now();
+
+        const double seconds = std::chrono::duration<double>(end - start).count();
+        const double rate = escaped_iterations(iters, view.max_iter) / seconds * 1e-6;
+        if (isa == Isa::Scalar) {
+            reference = iters;
+            scalar_rate = rate;
+        }
+
+        std::cout << isa_name(isa) << ": " << seconds * 1e3 << " ms, "
+                  << rate << " Miter/s, x" << rate / scalar_rate << " over scalar";
+        if (iters.iter != reference.iter)
+            std::cout << " (MISMATCH with scalar)";
+        std::cout << "\n";
+    }
+
+    return 0;
+}
+
+// Time one specialization of escape_time() and escape_time_dynamic() set up
+// the same way, on every pixel of view, on the calling thread.
+template <Formula F, typename T, unsigned Outputs, int Power = 2>
+static void bench_kernel(const View& view, const char* name)
+{
+    KernelConfig config;
+    config.formula = F;
+    config.power = Power;
+    config.outputs = Outputs;
+
+    const size_t count = static_cast<size_t>(view.width) * view.height;
+    std::vector<T> cx(count);
+    std::vector<T> cy(count);
+    for (int y = 0; y < view.height; ++y) {
+        for (int x = 0; x < view.width; ++x)
+            pixel_to_plane(view, x, y, cx[y * view.width + x], cy[y * view.width + x]);
+    }
+
+    std::vector<EscapeResult<T>> fixed(count);
+    std::vector<EscapeResult<T>> dynamic(count);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i)
+        fixed[i] = escape_time<F, T, Outputs, Power>(cx[i], cy[i], view.max_iter);
+    const double fixed_seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i)
+        dynamic[i] = escape_time_dynamic(config, cx[i], cy[i], view.max_iter);
+    const double dynamic_seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < count; ++i) {
+        mismatches += fixed[i].iter != dynamic[i].iter ||
+                      ((Outputs & OUTPUT_SMOOTH) && fixed[i].smooth != dynamic[i].smooth) ||
+                      ((Outputs & OUTPUT_DISTANCE) && fixed[i].distance != dynamic[i].distance);
+    }
+
+    std::cout << name << (sizeof(T) == sizeof(float) ? " float" : " double") << ": "
+              << fixed_seconds * 1e3 << " ms specialized, " << dynamic_seconds * 1e3
+              << " ms runtime branching, x" << dynamic_seconds / fixed_seconds;
+    if (mismatches)
+        std::cout << " (" << mismatches << " MISMATCHES)";
+    std::cout << "\n";
+}
+
+static int run_kernel_bench(const View& view)
+{
+    bench_kernel<Formula::Mandelbrot, float, OUTPUT_NONE>(view, "z^2+c");
+    bench_kernel<Formula::Mandelbrot, double, OUTPUT_NONE>(view, "z^2+c");
+    bench_kernel<Formula::Mandelbrot, double, OUTPUT_SMOOTH>(view, "z^2+c smooth");
+    bench_kernel<Formula::Mandelbrot, double, OUTPUT_DISTANCE>(view, "z^2+c distance");
+    bench_kernel<Formula::Mandelbrot, double, OUTPUT_SMOOTH | OUTPUT_DISTANCE>(view, "z^2+c smooth+distance");
+    bench_kernel<Formula::Power, double, OUTPUT_NONE, 3>(view, "z^3+c");
+    bench_kernel<Formula::Power, double, OUTPUT_SMOOTH, 4>(view, "z^4+c smooth");
+    bench_kernel<Formula::BurningShip, double, OUTPUT_NONE>(view, "burning ship");
+    bench_kernel<Formula::BurningShip, double, OUTPUT_DISTANCE>(view, "burning ship distance");
+    return 0;
+}
+
+static double render_timed(const View& view, IterBuffer& iters, const RenderOptions& options,
+                           RenderStats& render_stats)
+{
+    const auto start = std::chrono::steady_clock::now();
+    render_iterations(view, iters, options, nullptr, &render_stats);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Pixels per band of a streamed render, about 28 MB of iterations and
+// colors, and the image size from which renders stream by default.
+static constexpr long long STREAM_BAND_PIXELS = 1 << 22;
+static constexpr long long STREAM_MIN_PIXELS = 1 << 28;
+
+struct StreamStats
+{
+    int bands = 0;
+    int band_rows = 0;
+    double seconds = 0.0;
+    int reference_length = 0; // 0 for views that need no perturbation
+    double reference_seconds = 0.0;
+    RenderStats render;
+};
+
+// Render view a band of rows at a time, each colored and handed to the PNG
+// encoder before the next, so images of any size fit in memory. Views past
+// double share one reference orbit between bands.
+static bool render_streamed(const View& view, const RenderOptions& options, int palette,
+                            const std::string& img_file, StreamStats& stats)
+{
+    const auto start = std::chrono::steady_clock::now();
+    PngWriter png;
+    if (!png.open(img_file, view.width, view.height, options.threads))
+        return false;
+
+    const bool perturbation = needs_perturbation(view);
+    PerturbationReference reference;
+    if (perturbation)
+        prepare_reference(view, options, reference);
+
+    const int band_rows = static_cast<int>(
+        std::clamp<long long>(STREAM_BAND_PIXELS / view.width, 1, view.height));
+    IterBuffer iters;
+    std::vector<unsigned char> rgb(static_cast<size_t>(band_rows) * view.width * 3);
+    stats = StreamStats();
+    bool saved = true;
+    for (int y = 0; saved && y < view.height; y += band_rows) {
+        const int rows = std::min(band_rows, view.height - y);
+        RenderStats band;
+        if (perturbation)
+            render_perturbation_rows(view, reference, y, rows, iters, options, nullptr, nullptr, &band);
+        else
+            render_rows(view, y, rows, iters, options, nullptr, &band);
+        stats.render.pixels += band.pixels;
+        stats.render.computed += band.computed;
+        stats.render.interior_skipped += band.interior_skipped;
+
+        colorize_rows(iters, view.max_iter, 0, rows, rgb.data(), palette);
+        saved = png.write_rows(rgb.data(), rows);
+    }
+    saved = png.close() && saved;
+
+    stats.bands = (view.height + band_rows - 1) / band_rows;
+    stats.band_rows = band_rows;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (perturbation) {
+        stats.reference_length = reference.orbit.length();
+        stats.reference_seconds = reference.reference_seconds;
+    }
+    return saved;
+}
+
+static int run_stream(const View& view, const RenderOptions& options, int palette,
+                      const std::string& img_file, bool show_stats)
+{
+    std::cout << "Saving image " + img_file << std::endl;
+    StreamStats stats;
+    if (!render_streamed(view, options, palette, img_file, stats)) {
+        std::cout << "Unable to write file " << img_file << "\n";
+        return -1;
+    }
+
+    if (show_stats) {
+        std::cout << "Streamed " << stats.bands << " bands of " << stats.band_rows << " rows in "
+                  << stats.seconds * 1e3 << " ms\n";
+        if (stats.reference_length > 0) {
+            std::cout << "Reference orbit: " << stats.reference_length << " iterations in "
+                      << stats.reference_seconds * 1e3 << " ms, shared by all bands\n";
+        }
+        std::cout << stats.render.computed << " of " << stats.render.pixels << " pixels computed ("
+                  << stats.render.computed_fraction() * 100.0 << "%), "
+                  << stats.render.interior_skipped
+                  << " of them in the main cardioid and period-2 bulb\n";
+    }
+    return 0;
+}
+
+// Rows are bottom to top, written as is like the captures of zoom so both
+// can be compared directly. Colored a strip at a time as the encoder takes
+// them, the RGB of the whole image is never held.
+static bool save_png(const IterBuffer& iters, int max_iter, int palette, const std::string& img_file,
+                     int threads)
+{
+    PngWriter png;
+    bool saved = png.open(img_file, iters.width, iters.height, threads);
+    std::vector<unsigned char> rgb(static_cast<size_t>(png.strip_rows()) * iters.width * 3);
+    for (int y = 0; saved && y < iters.height; y += png.strip_rows()) {
+        const int rows = std::min(png.strip_rows(), iters.height - y);
+        colorize_rows(iters, max_iter, y, rows, rgb.data(), palette);
+        saved = png.write_rows(rgb.data(), rows);
+    }
+    return png.close() && saved;
+}
+
+// Cache of tile_cache_mb megabytes, backed by store opened at store_file
+// unless it is empty. Null with a message when the store does not open.
+static std::unique_ptr<TileCache> open_tile_cache(double tile_cache_mb, const std::string& store_file,
+                                                  TileStore& store)
+{
+    if (!store_file.empty() && !store.open(store_file)) {
+        std::cout << "Unable to open tile store " << store_file << "\n";
+        return nullptr;
+    }
+    return std::make_unique<TileCache>(static_cast<size_t>(tile_cache_mb * 1024.0 * 1024.0),
+                                       store_file.empty() ? nullptr : &store);
+}
+
+// One image of a job file, see load_jobs().
+struct BatchJob
+{
+    View view;
+    int palette = 0;
+    std::string output;
+};
+
+// Text of a number, written as a JSON number or as a string. Strings let
+// a zoom past 1e308 through tools that parse numbers as double.
+static bool number_text(const JsonValue* value, std::string& text)
+{
+    if (!value || (value->type != JsonValue::Type::Number && value->type != JsonValue::Type::String))
+        return false;
+    text = value->text;
+    return true;
+}
+
+// Whole text as an int: no sign but a leading '-', no fraction or exponent,
+// nothing past the range of int.
+static bool parse_int(const std::string& text, int& result)
+{
+    const char* end = text.data() + text.size();
+    const std::from_chars_result parsed = std::from_chars(text.data(), end, result);
+    return parsed.ec == std::errc() && parsed.ptr == end;
+}
+
+static bool parse_int(const JsonValue* value, int& result)
+{
+    std::string text;
+    return number_text(value, text) && parse_int(text, result);
+}
+
+// Whole text as a finite double, in decimal.
+static bool parse_double(const std::string& text, double& result)
+{
+    const char* end = text.data() + text.size();
+    const std::from_chars_result parsed = std::from_chars(text.data(), end, result);
+    return parsed.ec == std::errc() && parsed.ptr == end && std::isfinite(result);
+}
+
+static bool parse_pair(const JsonValue* value, std::string text[2])
+{
+    return value && value->type == JsonValue::Type::Array && value->items.size() == 2 &&
+           number_text(&value->items[0], text[0]) && number_text(&value->items[1], text[1]);
+}
+
+static bool parse_job(const JsonValue& value, BatchJob& job, std::string& error)
+{
+    if (value.type != JsonValue::Type::Object) {
+        error = "a job is not an object";
+        return false;
+    }
+
+    // Same defaults as the command line.
+    job.view.width = 1280;
+    job.view.height = 960;
+    for (const auto& member : value.members) {
+        const std::string& key = member.first;
+        const JsonValue* field = &member.second;
+        std::string pair[2];
+        std::string text;
+        bool valid;
+        if (key == "center") {
+            valid = parse_pair(field, pair) && BigFixed::parse(pair[0], job.view.center[0]) &&
+                    BigFixed::parse(pair[1], job.view.center[1]);
+        }
+        else if (key == "zoom") {
+            valid = number_text(field, text) && FloatExp::parse(text, job.view.zoom) &&
+                    job.view.zoom > 0.0;
+        }
+        else if (key == "size") {
+            valid = field->type == JsonValue::Type::Array && field->items.size() == 2 &&
+                    parse_int(&field->items[0], job.view.width) &&
+                    parse_int(&field->items[1], job.view.height) &&
+                    job.view.width > 0 && job.view.height > 0;
+        }
+        else if (key == "max_iter") {
+            valid = parse_int(field, job.view.max_iter) && job.view.max_iter > 0;
+        }
+        else if (key == "palette") {
+            valid = parse_int(field, job.palette) && job.palette >= 0 && job.palette < PALETTE_COUNT;
+        }
+        else if (key == "output") {
+            valid = field->type == JsonValue::Type::String && !field->text.empty();
+            job.output = field->text;
+        }
+        else {
+            error = "unknown field \"" + key + "\"";
+            return false;
+        }
+        if (!valid) {
+            error = "invalid \"" + key + "\"";
+            return false;
+        }
+    }
+    if (job.output.empty()) {
+        error = "no \"output\"";
+        return false;
+    }
+    return true;
+}
+
+// Read a job file, a JSON array of jobs or an object with one in "jobs":
+//   {"jobs": [{"center": [-0.5, 0], "zoom": 1.2, "size": [1280, 960],
+//              "max_iter": 200, "palette": 0, "output": "whole.png"}]}
+// Only "output" is required, the rest defaults like the command line. No two
+// jobs may have the same output.
+static bool load_jobs(const std::string& file, std::vector<BatchJob>& jobs)
+{
+    std::ifstream in(file, std::ios::binary);
+    if (!in) {
+        std::cout << "Unable to read file " << file << "\n";
+        return false;
+    }
+    std::stringstream text;
+    text << in.rdbuf();
+
+    JsonValue document;
+    std::string error;
+    if (!parse_json(text.str(), document, error)) {
+        std::cout << file << ": " << error << "\n";
+        return false;
+    }
+    const JsonValue* list = document.type == JsonValue::Type::Object ? document.find("jobs")
+                                                                     : &document;
+    if (!list || list->type != JsonValue::Type::Array) {
+        std::cout << file << ": expected an array of jobs\n";
+        return false;
+    }
+
+    // Jobs run at once, two of them writing the same file would interleave
+    // their rows. Paths are compared as written.
+    std::set<std::string> outputs;
+    jobs.resize(list->items.size());
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        if (!parse_job(list->items[i], jobs[i], error)) {
+            std::cout << file << ": job " << i + 1 << ": " << error << "\n";
+            return false;
+        }
+        if (!outputs.insert(jobs[i].output).second) {
+            std::cout << file << ": job " << i + 1 << ": \"output\" " << jobs[i].output
+                      << " already written by another job\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Render every job of file. Up to workers jobs run at once, default one per
+// thread but no more than there are jobs, and share the threads between
+// them: a batch of small images keeps every core busy with its own image,
+// a few large ones split the cores. Jobs stream (see render_streamed()), so
+// memory stays bounded whatever their size.
+// With a cache, jobs are moved to the nearest tile grid and put together
+// from the tiles of cache instead, shared by every job: views that overlap
+// iterate their common tiles once, unless two jobs get to them at the same
+// time.
+static int run_batch(const std::string& file, const RenderOptions& options, int workers,
+                     TileCache* cache, bool show_stats)
+{
+    std::vector<BatchJob> jobs;
+    if (!load_jobs(file, jobs))
+        return -1;
+    if (jobs.empty()) {
+        std::cout << file << ": no jobs\n";
+        return 0;
+    }
+
+    const int threads = options.threads > 0 ? options.threads : default_thread_count();
+    if (workers <= 0)
+        workers = threads;
+    workers = std::clamp(workers, 1, static_cast<int>(jobs.size()));
+    RenderOptions job_options = options;
+    job_options.threads = std::max(threads / workers, 1);
+    std::cout << jobs.size() << " jobs, " << workers << " at a time on "
+              << job_options.threads << " threads each\n";
+
+    const auto start = std::chrono::steady_clock::now();
+    std::atomic<size_t> next_job(0);
+    std::atomic<int> failed(0);
+    std::mutex print_mutex;
+    auto work = [&] {
+        for (size_t i = next_job++; i < jobs.size(); i = next_job++) {
+            const BatchJob& job = jobs[i];
+            StreamStats stats;
+            bool saved;
+            if (cache) {
+                const auto job_start = std::chrono::steady_clock::now();
+                const View view = snap_to_tiles(job.view);
+                IterBuffer iters;
+                render_tiled(view, *cache, iters, job_options, &stats.render);
+                saved = save_png(iters, view.max_iter, job.palette, job.output, job_options.threads);
+                stats.seconds =
+                    std::chrono::duration<double>(std::chrono::steady_clock::now() - job_start).count();
+            }
+            else {
+                saved = render_streamed(job.view, job_options, job.palette, job.output, stats);
+            }
+            failed += !saved;
+
+            std::lock_guard<std::mutex> lock(print_mutex);
+            std::cout << "[" << i + 1 << "/" << jobs.size() << "] " << job.output;
+            if (!saved) {
+                std::cout << ": unable to write file\n";
+                continue;
+            }
+            const double pixels = static_cast<double>(job.view.width) * job.view.height;
+            std::cout << ": " << job.view.width << "x" << job.view.height << " in "
+                      << stats.seconds * 1e3 << " ms, " << pixels / stats.seconds * 1e-6 << " Mpixel/s";
+            if (cache)
+                std::cout << ", " << stats.render.pixels / (TILE_PIXELS * TILE_PIXELS) << " tiles rendered";
+            if (stats.reference_length > 0)
+                std::cout << ", reference orbit " << stats.reference_seconds * 1e3 << " ms";
+            std::cout << "\n";
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int i = 1; i < workers; ++i)
+        pool.emplace_back(work);
+    work();
+    for (std::thread& thread : pool)
+        thread.join();
+
+    const std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+    std::cout << jobs.size() - failed << " of " << jobs.size() << " jobs done in "
+              << seconds.count() << " s\n";
+    if (cache && show_stats)
+        print_cache_stats(cache->stats());
+    return failed > 0 ? -1 : 0;
+}
+
+// Pixels of an animation frame take the count of the frame before if it was
+// computed within this many pixels of their center. Half a pixel keeps every
+// count inside the pixel that shows it.
+static constexpr double DEFAULT_REUSE = 0.5;
+
+// Render frames views from start to end (see animation_frame()) as a Y4M
+// video. Frames past double share one reference orbit, at the deepest
+// keyframe, and each is seeded with the one before unless reuse is 0.
+static int run_animation(const View& start, const View& end, int frames, int fps, double reuse,
+                         const RenderOptions& options, int palette, const std::string& file,
+                         bool show_stats)
+{
+    // The video may be on standard output, messages go to the other one.
+    std::ostream& log = file == "-" ? std::cerr : std::cout;
+    Y4mWriter video;
+    if (!video.open(file, start.width, start.height, fps)) {
+        log << "Unable to write file " << file << "\n";
+        return -1;
+    }
+
+    const View& deepest = end.zoom > start.zoom ? end : start;
+    PerturbationReference reference;
+    FrameSamples previous;
+    FrameSamples frame;
+    std::vector<unsigned char> keep;
+    std::vector<unsigned char> rgb(static_cast<size_t>(start.width) * start.height * 3);
+    const auto animation_start = std::chrono::steady_clock::now();
+    long long total_computed = 0;
+    bool written = true;
+    for (int i = 0; written && i < frames; ++i) {
+        const auto frame_start = std::chrono::steady_clock::now();
+        const View view = animation_frame(start, end, i, frames);
+        RenderOptions frame_options = options;
+        long long seeded = 0;
+        if (i > 0 && reuse > 0.0) {
+            seeded = reproject_frame(previous, view, reuse, frame, keep);
+            frame_options.keep = keep.data();
+            frame_options.column_offset = frame.column_offset.data();
+            frame_options.row_offset = frame.row_offset.data();
+        }
+        else {
+            frame.view = view;
+            frame.column_offset.assign(view.width, 0.0f);
+            frame.row_offset.assign(view.height, 0.0f);
+        }
+
+        RenderStats render_stats;
+        if (needs_perturbation(view)) {
+            if (reference.orbit.length() == 0) {
+                prepare_reference(deepest, options, reference);
+                log << "Reference orbit: " << reference.orbit.length() << " iterations in "
+                    << reference.reference_seconds * 1e3 << " ms, shared by all frames\n";
+            }
+            prepare_bla(view, options, reference);
+            render_perturbation_rows(view, reference, 0, view.height, frame.iters, frame_options,
+                                     nullptr, nullptr, &render_stats);
+        }
+        else {
+            render_rows(view, 0, view.height, frame.iters, frame_options, nullptr, &render_stats);
+        }
+        total_computed += render_stats.computed;
+
+        colorize_rows(frame.iters, view.max_iter, 0, view.height, rgb.data(), palette);
+        written = video.write_frame(rgb.data());
+        std::swap(previous, frame);
+
+        if (show_stats) {
+            const std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - frame_start;
+            log << "Frame " << i + 1 << "/" << frames << ": zoom " << view.zoom.to_string() << ", "
+                << seeded * 100.0 / render_stats.pixels << "% seeded, "
+                << render_stats.computed << " pixels computed in " << seconds.count() * 1e3 << " ms\n";
+        }
+    }
+    written = video.close() && written;
+    if (!written) {
+        log << "Unable to write file " << file << "\n";
+        return -1;
+    }
+
+    const std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - animation_start;
+    const double pixels = static_cast<double>(start.width) * start.height * frames;
+    log << frames << " frames in " << seconds.count() << " s, " << frames / seconds.count()
+        << " frames/s, " << total_computed / pixels * 100.0 << "% of pixels computed\n";
+    return 0;
+}
+
+// Render a few well known views with every strategy, and count the pixels
+// that differ from brute force. Strategies infer pixels from the ones around
+// them and may miss details thinner than a pixel, up to STRATEGY_TOLERANCE of
+// a view (30 pixels of 640x480) are accepted. Then the same for BLA against
+// plain perturbation, which must change none of them. Non-zero if either is
+// exceeded.
+static constexpr double STRATEGY_TOLERANCE = 1e-4;
+
+static int run_verify(RenderOptions options)
+{
+    struct ReferenceView
+    {
+        const char* name;
+        const char* center[2];
+        const char* zoom;
+        int max_iter;
+    };
+    static const ReferenceView views[] = {
+        {"whole set", {"-0.5", "0"}, "1", 1000},
+        {"seahorse valley", {"-0.7453", "0.1127"}, "300", 2000},
+        {"elephant valley", {"0.285", "0.011"}, "100", 2000},
+        {"period-3 bulb", {"-0.1225", "0.7449"}, "8", 5000},
+        {"deep spiral", {"-0.743643887037158704752191506114774", "0.131825904205311970493132056385139"},
+         "1e20", 5000},
+    };
+
+    auto make_view = [](const ReferenceView& reference) {
+        View view;
+        BigFixed::parse(reference.center[0], view.center[0]);
+        BigFixed::parse(reference.center[1], view.center[1]);
+        FloatExp::parse(reference.zoom, view.zoom);
+        view.width = 640;
+        view.height = 480;
+        view.max_iter = reference.max_iter;
+        return view;
+    };
+
+    bool failed = false;
+    for (const ReferenceView& reference : views) {
+        const View view = make_view(reference);
+        const size_t tolerance = static_cast<size_t>(STRATEGY_TOLERANCE * view.width * view.height);
+
+        IterBuffer brute;
+        RenderStats brute_stats;
+        options.strategy = Strategy::BruteForce;
+        const double brute_seconds = render_timed(view, brute, options, brute_stats);
+        std::cout << reference.name << ": brute-force " << brute_seconds * 1e3 << " ms\n";
+
+        for (int i = 1; i < STRATEGY_COUNT; ++i) {
+            IterBuffer iters;
+            RenderStats render_stats;
+            options.strategy = static_cast<Strategy>(i);
+            const double seconds = render_timed(view, iters, options, render_stats);
+
+            size_t mismatches = 0;
+            for (size_t k = 0; k < iters.iter.size(); ++k)
+                mismatches += iters.iter[k] != brute.iter[k];
+            std::cout << "  " << strategy_name(options.strategy) << ": " << seconds * 1e3
+                      << " ms, " << render_stats.computed_fraction() * 100.0
+                      << "% of pixels computed, " << mismatches << " differ from brute force\n";
+            if (mismatches > tolerance) {
+                std::cout << "  more than " << tolerance << " pixels differ\n";
+                failed = true;
+            }
+        }
+    }
+
+    // BLA against plain perturbation around the same reference, off the
+    // real axis: where the table is dropped as useless, where it just pays
+    // off and where it skips most iterations. Steps err no more than the
+    // iterations they replace, none of these pixels may change.
+    static const ReferenceView bla_views[] = {
+        {"spiral at 1e14", {"-0.743643887037158704752191506114774", "0.131825904205311970493132056385139"},
+         "1e14", 5000},
+        {"spiral at 1e20", {"-0.743643887037158704752191506114774", "0.131825904205311970493132056385139"},
+         "1e20", 5000},
+        {"spiral at 1e30", {"-0.743643887037158704752191506114774", "0.131825904205311970493132056385139"},
+         "1e30", 5000},
+    };
+    options.strategy = Strategy::BruteForce;
+    for (const ReferenceView& reference : bla_views) {
+        const View view = make_view(reference);
+        IterBuffer plain, skipped;
+        auto render = [&](bool bla, IterBuffer& iters) {
+            options.bla = bla;
+            const auto start = std::chrono::steady_clock::now();
+            render_perturbation(view, iters, options);
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        };
+        const double plain_seconds = render(false, plain);
+        const double bla_seconds = render(true, skipped);
+
+        size_t mismatches = 0;
+        for (size_t k = 0; k < plain.iter.size(); ++k)
+            mismatches += plain.iter[k] != skipped.iter[k];
+        std::cout << reference.name << ": perturbation " << plain_seconds * 1e3 << " ms, BLA "
+                  << bla_seconds * 1e3 << " ms, " << mismatches << " differ\n";
+        if (mismatches > 0) {
+            std::cout << "  BLA changed pixels of plain perturbation\n";
+            failed = true;
+        }
+    }
+
+    std::cout << (failed ? "FAILED\n" : "passed\n");
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+    View view;
+    view.width = 1280;
+    view.height = 960;
+    std::string img_file = "render.png";
+    bool bench = false;
+    bool bench_kernels = false;
+    bool verify = false;
+    bool show_stats = false;
+    bool stream = false;
+    int palette = 0;
+    std::string batch_file;
+    int batch_workers = 0;
+    bool output_given = false;
+    int frames = 0;
+    BigFixed end_center[2];
+    FloatExp end_zoom;
+    bool end_center_given = false;
+    bool end_zoom_given = false;
+    int fps = 30;
+    double reuse = DEFAULT_REUSE;
+    double tile_cache_mb = 0.0;
+    std::string tile_store_file;
+    RenderOptions options;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const int args_left = argc - i - 1;
+        if (arg == "--center" && args_left >= 2) {
+            // Parsed in full precision for deep zooms.
+            if (!BigFixed::parse(argv[i + 1], view.center[0]) ||
+                !BigFixed::parse(argv[i + 2], view.center[1])) {
+                std::cout << "Invalid center " << argv[i + 1] << " " << argv[i + 2] << "\n";
+                return -1;
+            }
+            i += 2;
+        }
+        else if (arg == "--zoom" && args_left >= 1) {
+            // Past 1e308 too, for zooms beyond the range of double.
+            if (!FloatExp::parse(argv[++i], view.zoom)) {
+                std::cout << "Invalid zoom " << argv[i] << "\n";
+                return -1;
+            }
+        }
+        else if (arg == "--size" && args_left >= 2) {
+            if (!parse_int(argv[i + 1], view.width) || !parse_int(argv[i + 2], view.height)) {
+                std::cout << "Invalid --size " << argv[i + 1] << " " << argv[i + 2] << "\n";
+                return -1;
+            }
+            i += 2;
+        }
+        else if (arg == "--max-iter" && args_left >= 1) {
+            if (!parse_int(argv[++i], view.max_iter)) {
+                std::cout << "Invalid --max-iter " << argv[i] << "\n";
+                return -1;
+            }
+        }
+        else if (arg == "--threads" && args_left >= 1) {
+            if (!parse_int(argv[++i], options.threads)) {
+                std::cout << "Invalid --threads " << argv[i] << "\n";
+                return -1;
+            }
+        }
+        else if (arg == "--tile" && args_left >= 1) {
+            if (!parse_int(argv[++i], options.tile_size)) {
+                std::cout << "Invalid --tile " << argv[i] << "\n";
+                return -1;
+            }
+        }
+        else if (arg == "--isa" && args_left >= 1) {
+            if (!parse_isa(argv[++i], options.isa) || !isa_supported(options.isa)) {
+                std::cout << "Instruction set " << argv[i] << " is not available.\n";
+                return -1;
+            }
+        }
+        else if (arg == "--no-bla") {
+            options.bla = false;
+        }
+        else if (arg == "--strategy" && args_left >= 1) {
+            if (!parse_strategy(argv[++i], options.strategy)) {
+                std::cout << "Unknown strategy " << argv[i] << "\n";
+                return -1;
+            }
+        }
+        else if (arg == "--tile-cache" && args_left >= 1) {
+            if (!parse_double(argv[++i], tile_cache_mb)) {
+                std::cout << "Invalid --tile-cache " << argv[i] << "\n";
+                return -1;
+            }
+        }
+        else if (arg == "--tile-store" && args_left >= 1) {
+            tile_store_file = argv[++i];
+        }
+        else if (arg == "--compact-store" && args_left >= 1) {
+            TileStoreStats before, after;
+            if (!compact_tile_store(argv[++i], &before, &after)) {
+                std::cout << "Unable to compact " << argv[i] << "\n";
+                return -1;
+            }
+            std::cout << "Compacted " << argv[i] << ": " << before.records << " records, "
+                      << before.file_bytes << " bytes -> " << after.records << " records, "
+                      << after.file_bytes << " bytes\n";
+            return 0;
+        }
+        else if (arg == "--stream") {
+            stream = true;
+        }
+        else if (arg == "--palette" && args_left >= 1) {
+            if (!parse_int(argv[++i], palette)) {
+                std::cout << "Invalid --palette " << argv[i] << "\n";
+                return -1;
+            }
+        }
+        else if (arg == "--batch" && args_left >= 1) {
+            batch_file = argv[++i];
+        }
+        else if (arg == "--jobs" && args_left >= 1) {
+            if (!parse_int(argv[++i], batch_workers)) {
+                std::cout << "Invalid --jobs " << argv[i] << "\n";
+                return -1;
+            }
+        }
+        else if (arg == "--animate" && args_left >= 1) {
+            if (!parse_int(argv[++i], frames) || frames <= 0) {
+                std::cout << "Invalid --animate " << argv[i] << "\n";
+                return -1;
+            }
+        }
+        else if (arg == "--end-center" && args_left >= 2) {
+            if (!BigFixed::parse(argv[i + 1], end_center[0]) ||
+                !BigFixed::parse(argv[i + 2], end_center[1])) {
+                std::cout << "Invalid center " << argv[i + 1] << " " << argv[i + 2] << "\n";
+                return -1;
+            }
+            end_center_given = true;
+            i += 2;
+        }
+        else if (arg == "--end-zoom" && args_left >= 1) {
+            if (!FloatExp::parse(argv[++i], end_zoom)) {
+                std::cout << "Invalid zoom " << argv[i] << "\n";
+                return -1;
+            }
+            end_zoom_given = true;
+        }
+        else if (arg == "--fps" && args_left >= 1) {
+            if (!parse_int(argv[++i], fps)) {
+                std::cout << "Invalid --fps " << argv[i] << "\n";
+                return -1;
+            }
+        }
+        else if (arg == "--reuse" && args_left >= 1) {
+            if (!parse_double(argv[++i], reuse)) {
+                std::cout << "Invalid --reuse " << argv[i] << "\n";
+                return -1;
+            }
+        }
+        else if (arg == "--stats") {
+            show_stats = true;
+        }
+        else if (arg == "--bench") {
+            bench = true;
+        }
+        else if (arg == "--bench-kernels") {
+            bench_kernels = true;
+        }
+        else if (arg == "--verify") {
+            verify = true;
+        }
+        else if (arg == "--help" || arg == "-h") {
+            print_usage();
+            return 0;
+        }
+        else if (arg[0] != '-' || arg == "-") {
+            img_file = arg;
+            output_given = true;
+        }
+        else {
+            std::cout << "Unknown option " << arg << "\n";
+            print_usage();
+            return -1;
+        }
+    }
+
+    if (view.width <= 0 || view.height <= 0 || view.max_iter <= 0 || view.zoom <= 0.0 ||
+        palette < 0 || palette >= PALETTE_COUNT) {
+        std::cout << "Invalid view parameters.\n";
+        return -1;
+    }
+
+    if (bench)
+        return run_bench(view);
+    if (bench_kernels)
+        return run_kernel_bench(view);
+
+    if (options.tile_size <= 0) {
+        std::cout << "Invalid tile size.\n";
+        return -1;
+    }
+    if (verify)
+        return run_verify(options);
+
+    if (!tile_store_file.empty() && tile_cache_mb <= 0.0)
+        tile_cache_mb = 256.0;
+    if (!batch_file.empty()) {
+        TileStore store;
+        std::unique_ptr<TileCache> cache;
+        if (tile_cache_mb > 0.0) {
+            cache = open_tile_cache(tile_cache_mb, tile_store_file, store);
+            if (!cache)
+                return -1;
+        }
+        return run_batch(batch_file, options, batch_workers, cache.get(), show_stats);
+    }
+    if (frames > 0) {
+        if (tile_cache_mb > 0.0) {
+            std::cout << "--animate does not go through the tile cache.\n";
+            return -1;
+        }
+        // The end keyframe differs from the view by its center and zoom only,
+        // size and iterations are those of the whole animation.
+        View end_view = view;
+        if (end_center_given) {
+            end_view.center[0] = end_center[0];
+            end_view.center[1] = end_center[1];
+        }
+        if (end_zoom_given)
+            end_view.zoom = end_zoom;
+        if (fps <= 0 || reuse < 0.0 || reuse > 1.0 || end_view.zoom <= 0.0) {
+            std::cout << "Invalid animation parameters.\n";
+            return -1;
+        }
+        return run_animation(view, end_view, frames, fps, reuse, options, palette,
+                             output_given ? img_file : "-", show_stats);
+    }
+    if (stream && tile_cache_mb > 0.0) {
+        std::cout << "--stream does not go through the tile cache.\n";
+        return -1;
+    }
+    const long long pixels = static_cast<long long>(view.width) * view.height;
+    if (stream || (tile_cache_mb <= 0.0 && pixels >= STREAM_MIN_PIXELS))
+        return run_stream(view, options, palette, img_file, show_stats);
+
+    IterBuffer iters;
+    SchedulerStats stats;
+    RenderStats render_stats;
+    if (tile_cache_mb > 0.0) {
+        // Tiles are on fixed grids, the view goes on the nearest one.
+        view = snap_to_tiles(view);
+        std::cout << "Tile grid view: --center " << view.center[0].to_string(20) << " "
+                  << view.center[1].to_string(20) << " --zoom " << view.zoom.to_string() << "\n";
+
+        TileStore store;
+        const std::unique_ptr<TileCache> cache = open_tile_cache(tile_cache_mb, tile_store_file, store);
+        if (!cache)
+            return -1;
+        render_tiled(view, *cache, iters, options, &render_stats);
+        if (show_stats) {
+            print_cache_stats(cache->stats());
+            if (!tile_store_file.empty()) {
+                const TileStoreStats store_stats = store.stats();
+                std::cout << "Tile store: " << store_stats.tiles << " tiles, "
+                          << store_stats.file_bytes / (1024.0 * 1024.0) << " MB\n";
+            }
+        }
+    }
+    else if (needs_perturbation(view)) {
+        PerturbationStats perturbation_stats;
+        render_perturbation(view, iters, options, &stats, &perturbation_stats, &render_stats);
+        if (show_stats) {
+            std::cout << "Reference orbit: " << perturbation_stats.reference_length
+                      << " iterations in " << perturbation_stats.reference_seconds * 1e3
+                      << " ms, " << perturbation_stats.glitches << " glitches, "
+                      << perturbation_stats.rebases << " rebases";
+            if (perturbation_stats.floatexp)
+                std::cout << ", extended exponent deltas";
+            std::cout << "\n";
+            if (options.bla) {
+                std::cout << "BLA table built in " << perturbation_stats.bla_seconds * 1e3
+                          << " ms, average skip " << perturbation_stats.average_skip()
+                          << " iterations over " << perturbation_stats.bla_steps << " steps\n";
+            }
+        }
+    }
+    else {
+        render_iterations(view, iters, options, &stats, &render_stats);
+    }
+    if (show_stats) {
+        // Through the cache, pixels of the whole tiles rendered.
+        if (tile_cache_mb > 0.0)
+            std::cout << render_stats.pixels / (TILE_PIXELS * TILE_PIXELS) << " tiles rendered: ";
+        std::cout << render_stats.computed << " of " << render_stats.pixels << " pixels computed ("
+                  << render_stats.computed_fraction() * 100.0 << "%), "
+                  << render_stats.interior_skipped
+                  << " of them in the main cardioid and period-2 bulb\n";
+        if (stats.threads > 0)
+            print_stats(stats);
+    }
+
+    std::cout << "Saving image " + img_file << std::endl;
+    const auto save_start = std::chrono::steady_clock::now();
+    if (!save_png(iters, view.max_iter, palette, img_file, options.threads)) {
+        std::cout << "Unable to write file " << img_file << "\n";
+        return -1;
+    }
+    if (show_stats) {
+        const std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - save_start;
+        std::cout << "PNG written in " << seconds.count() * 1e3 << " ms\n";
+    }
+
+    return 0;
+}
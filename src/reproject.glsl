@@ -0,0 +1,25 @@
+#version 400 core
+
+// First estimate of a zoomed view: each pixel takes the iterations of the
+// pixel of the last frame under its center. z is how far, in pixels of the
+// new view, the point that was iterated may be from this pixel; the
+// iteration shaders recompute the furthest off first.
+
+out vec4 frag_iter;
+
+uniform sampler2D u_previous;
+uniform vec2 u_origin; // where (0, 0) of this view falls in the last one, in its pixels
+uniform float u_scale; // size of a pixel of this view in pixels of the last one
+
+void main()
+{
+    vec2 position = u_origin + gl_FragCoord.xy * u_scale;
+    ivec2 size = textureSize(u_previous, 0);
+    ivec2 source = clamp(ivec2(floor(position)), ivec2(0), size - 1);
+    vec4 previous = texelFetch(u_previous, source, 0);
+
+    // Off by the distance to the center of the source pixel, on top of
+    // what the source already was.
+    float distance = length(position - (vec2(source) + 0.5));
+    frag_iter = vec4(previous.xy, (previous.z + distance) / u_scale, 0.0);
+}
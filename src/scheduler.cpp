@@ -0,0 +1,131 @@
+#include "scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+
+struct WorkQueue
+{
+    std::mutex mutex;
+    std::deque<Tile> tiles;
+
+    // Owner end.
+    bool pop(Tile& tile)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (tiles.empty())
+            return false;
+        tile = tiles.back();
+        tiles.pop_back();
+        return true;
+    }
+
+    // Thief end, farthest from what the owner is working on.
+    bool steal(Tile& tile)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (tiles.empty())
+            return false;
+        tile = tiles.front();
+        tiles.pop_front();
+        return true;
+    }
+};
+
+} // namespace
+
+double SchedulerStats::efficiency() const
+{
+    if (threads == 0 || wall_seconds <= 0.0)
+        return 0.0;
+
+    double busy = 0.0;
+    for (double seconds : busy_seconds)
+        busy += seconds;
+    return busy / (threads * wall_seconds);
+}
+
+int default_thread_count()
+{
+    const unsigned int count = std::thread::hardware_concurrency();
+    return count > 0 ? static_cast<int>(count) : 1;
+}
+
+void run_tiles(int width, int height, int tile_size, int threads,
+               const std::function<void(const Tile&)>& task,
+               SchedulerStats* stats)
+{
+    const auto start = Clock::now();
+    tile_size = std::max(tile_size, 1);
+    if (threads <= 0)
+        threads = default_thread_count();
+
+    std::vector<Tile> tiles;
+    for (int y = 0; y < height; y += tile_size) {
+        for (int x = 0; x < width; x += tile_size) {
+            Tile tile;
+            tile.x0 = x;
+            tile.y0 = y;
+            tile.width = std::min(tile_size, width - x);
+            tile.height = std::min(tile_size, height - y);
+            tiles.push_back(tile);
+        }
+    }
+    threads = std::max(1, std::min(threads, static_cast<int>(tiles.size())));
+
+    // Contiguous blocks keep neighbouring tiles on the same thread, stealing
+    // evens out the imbalance this creates.
+    std::vector<WorkQueue> queues(threads);
+    for (size_t i = 0; i < tiles.size(); ++i)
+        queues[i * threads / tiles.size()].tiles.push_back(tiles[i]);
+
+    std::vector<int> tiles_done(threads, 0);
+    std::vector<int> steals(threads, 0);
+    std::vector<double> busy_seconds(threads, 0.0);
+
+    auto worker = [&](int id) {
+        Tile tile;
+        for (;;) {
+            bool found = queues[id].pop(tile);
+
+            // Tiles are never added once started, so finding every queue
+            // empty once means the work is done.
+            for (int k = 1; !found && k < threads; ++k) {
+                if (queues[(id + k) % threads].steal(tile)) {
+                    found = true;
+                    ++steals[id];
+                }
+            }
+            if (!found)
+                break;
+
+            const auto tile_start = Clock::now();
+            task(tile);
+            busy_seconds[id] += std::chrono::duration<double>(Clock::now() - tile_start).count();
+            ++tiles_done[id];
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int id = 1; id < threads; ++id)
+        pool.emplace_back(worker, id);
+    worker(0);
+    for (std::thread& thread : pool)
+        thread.join();
+
+    if (stats) {
+        stats->threads = threads;
+        stats->tiles = static_cast<int>(tiles.size());
+        stats->wall_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        stats->tiles_done = std::move(tiles_done);
+        stats->steals = std::move(steals);
+        stats->busy_seconds = std::move(busy_seconds);
+    }
+}
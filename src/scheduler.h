@@ -0,0 +1,43 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+// Work-stealing tile scheduler.
+// The image is cut into square tiles which are dealt in contiguous blocks to
+// one deque per thread. A thread works from the back of its own deque and,
+// once it is empty, steals from the front of the others. Tiles inside the set
+// cost max_iter per pixel while the outside escapes quickly, so stealing is
+// what keeps all threads busy until the end.
+
+struct Tile
+{
+    int x0 = 0;
+    int y0 = 0;
+    int width = 0;
+    int height = 0;
+};
+
+struct SchedulerStats
+{
+    int threads = 0;
+    int tiles = 0;
+    double wall_seconds = 0.0;
+
+    // Per thread.
+    std::vector<int> tiles_done;
+    std::vector<int> steals;
+    std::vector<double> busy_seconds;
+
+    // Busy time over available thread time, 1 means no thread idled.
+    double efficiency() const;
+};
+
+// Number of threads used when 0 is requested.
+int default_thread_count();
+
+// Run task on every tile_size x tile_size tile of a width x height image,
+// using threads workers (default_thread_count() if 0). Blocks until done.
+void run_tiles(int width, int height, int tile_size, int threads,
+               const std::function<void(const Tile&)>& task,
+               SchedulerStats* stats = nullptr);
@@ -0,0 +1,269 @@
+#include "simd.h"
+
+#include "kernel.h"
+
+#include <cmath>
+#include <vector>
+
+#if defined(FRACTAL_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+const char* isa_name(Isa isa)
+{
+    switch (isa) {
+    case Isa::SSE2: return "SSE2";
+    case Isa::AVX2: return "AVX2";
+    case Isa::AVX512: return "AVX-512";
+    default: return "scalar";
+    }
+}
+
+int isa_lanes(Isa isa)
+{
+    switch (isa) {
+    case Isa::SSE2: return 4;
+    case Isa::AVX2: return 8;
+    case Isa::AVX512: return 16;
+    default: return 1;
+    }
+}
+
+#if defined(FRACTAL_X86)
+
+static void cpuid(int leaf, int subleaf, unsigned int regs[4])
+{
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuidex(r, leaf, subleaf);
+    for (int i = 0; i < 4; ++i)
+        regs[i] = static_cast<unsigned int>(r[i]);
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Register state enabled by the OS in XCR0.
+static unsigned long long xgetbv0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned int eax, edx;
+    __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+}
+
+bool isa_supported(Isa isa)
+{
+    if (isa == Isa::Scalar || isa == Isa::SSE2)
+        return true; // Part of x86-64 baseline.
+
+    unsigned int regs[4];
+    cpuid(0, 0, regs);
+    const unsigned int max_leaf = regs[0];
+    if (max_leaf < 7)
+        return false;
+
+    // OSXSAVE is required to query which registers the OS saves.
+    cpuid(1, 0, regs);
+    if (!(regs[2] & (1u << 27)))
+        return false;
+    const unsigned long long xcr0 = xgetbv0();
+
+    cpuid(7, 0, regs);
+    const unsigned int ebx = regs[1];
+    if (isa == Isa::AVX2)
+        return (xcr0 & 0x6) == 0x6 && (ebx & (1u << 5));
+    if (isa == Isa::AVX512)
+        return (xcr0 & 0xe6) == 0xe6 && (ebx & (1u << 16));
+    return false;
+}
+
+#else
+
+bool isa_supported(Isa isa)
+{
+    return isa == Isa::Scalar;
+}
+
+#endif
+
+Isa best_isa()
+{
+    static const Isa best = [] {
+        const Isa order[3] = {Isa::AVX512, Isa::AVX2, Isa::SSE2};
+        for (Isa isa : order) {
+            if (isa_supported(isa))
+                return isa;
+        }
+        return Isa::Scalar;
+    }();
+    return best;
+}
+
+static void row_kernel_scalar(const float* cx, float cy, int count, int max_iter, int* iter)
+{
+    for (int i = 0; i < count; ++i)
+        iter[i] = escape_time<Formula::Mandelbrot>(cx[i], cy, max_iter).iter;
+}
+
+static void row_kernel_scalar_f64(const double* cx, double cy, int count, int max_iter, int* iter)
+{
+    for (int i = 0; i < count; ++i)
+        iter[i] = escape_time<Formula::Mandelbrot>(cx[i], cy, max_iter).iter;
+}
+
+static void point_kernel_scalar(const float* cx, const float* cy, int count, int max_iter, int* iter)
+{
+    for (int i = 0; i < count; ++i)
+        iter[i] = escape_time<Formula::Mandelbrot>(cx[i], cy[i], max_iter).iter;
+}
+
+static void point_kernel_scalar_f64(const double* cx, const double* cy, int count, int max_iter, int* iter)
+{
+    for (int i = 0; i < count; ++i)
+        iter[i] = escape_time<Formula::Mandelbrot>(cx[i], cy[i], max_iter).iter;
+}
+
+// Run Kernel on the points of the row outside the main cardioid and period-2
+// bulb only, packed together so each vector holds points that may escape.
+template <typename T, void (*Kernel)(const T*, T, int, int, int*)>
+static int skip_main_bulbs(const T* cx, T cy, int count, int max_iter, int* iter)
+{
+    if (std::fabs(cy) > T(MAIN_BULBS_MAX_Y)) {
+        Kernel(cx, cy, count, max_iter, iter);
+        return 0;
+    }
+
+    thread_local std::vector<T> packed_cx;
+    thread_local std::vector<int> packed_iter;
+    thread_local std::vector<int> index;
+    packed_cx.clear();
+    index.clear();
+    for (int i = 0; i < count; ++i) {
+        if (in_main_bulbs(cx[i], cy)) {
+            iter[i] = max_iter;
+        }
+        else {
+            packed_cx.push_back(cx[i]);
+            index.push_back(i);
+        }
+    }
+
+    const int packed = static_cast<int>(index.size());
+    if (packed == count) {
+        Kernel(cx, cy, count, max_iter, iter);
+        return 0;
+    }
+
+    packed_iter.resize(packed);
+    Kernel(packed_cx.data(), cy, packed, max_iter, packed_iter.data());
+    for (int i = 0; i < packed; ++i)
+        iter[index[i]] = packed_iter[i];
+    return count - packed;
+}
+
+// Same for points anywhere.
+template <typename T, void (*Kernel)(const T*, const T*, int, int, int*)>
+static int skip_main_bulbs_points(const T* cx, const T* cy, int count, int max_iter, int* iter)
+{
+    thread_local std::vector<T> packed_cx;
+    thread_local std::vector<T> packed_cy;
+    thread_local std::vector<int> packed_iter;
+    thread_local std::vector<int> index;
+    packed_cx.clear();
+    packed_cy.clear();
+    index.clear();
+    for (int i = 0; i < count; ++i) {
+        if (std::fabs(cy[i]) <= T(MAIN_BULBS_MAX_Y) && in_main_bulbs(cx[i], cy[i])) {
+            iter[i] = max_iter;
+        }
+        else {
+            packed_cx.push_back(cx[i]);
+            packed_cy.push_back(cy[i]);
+            index.push_back(i);
+        }
+    }
+
+    const int packed = static_cast<int>(index.size());
+    if (packed == count) {
+        Kernel(cx, cy, count, max_iter, iter);
+        return 0;
+    }
+
+    packed_iter.resize(packed);
+    Kernel(packed_cx.data(), packed_cy.data(), packed, max_iter, packed_iter.data());
+    for (int i = 0; i < packed; ++i)
+        iter[index[i]] = packed_iter[i];
+    return count - packed;
+}
+
+RowKernel row_kernel(Isa isa)
+{
+    if (!isa_supported(isa))
+        return skip_main_bulbs<float, row_kernel_scalar>;
+
+#if defined(FRACTAL_X86)
+    switch (isa) {
+    case Isa::SSE2: return skip_main_bulbs<float, row_kernel_sse2>;
+    case Isa::AVX2: return skip_main_bulbs<float, row_kernel_avx2>;
+    case Isa::AVX512: return skip_main_bulbs<float, row_kernel_avx512>;
+    default: break;
+    }
+#endif
+    return skip_main_bulbs<float, row_kernel_scalar>;
+}
+
+RowKernel64 row_kernel_f64(Isa isa)
+{
+    if (!isa_supported(isa))
+        return skip_main_bulbs<double, row_kernel_scalar_f64>;
+
+#if defined(FRACTAL_X86)
+    switch (isa) {
+    case Isa::SSE2: return skip_main_bulbs<double, row_kernel_sse2_f64>;
+    case Isa::AVX2: return skip_main_bulbs<double, row_kernel_avx2_f64>;
+    case Isa::AVX512: return skip_main_bulbs<double, row_kernel_avx512_f64>;
+    default: break;
+    }
+#endif
+    return skip_main_bulbs<double, row_kernel_scalar_f64>;
+}
+
+PointKernel point_kernel(Isa isa)
+{
+    if (!isa_supported(isa))
+        return skip_main_bulbs_points<float, point_kernel_scalar>;
+
+#if defined(FRACTAL_X86)
+    switch (isa) {
+    case Isa::SSE2: return skip_main_bulbs_points<float, point_kernel_sse2>;
+    case Isa::AVX2: return skip_main_bulbs_points<float, point_kernel_avx2>;
+    case Isa::AVX512: return skip_main_bulbs_points<float, point_kernel_avx512>;
+    default: break;
+    }
+#endif
+    return skip_main_bulbs_points<float, point_kernel_scalar>;
+}
+
+PointKernel64 point_kernel_f64(Isa isa)
+{
+    if (!isa_supported(isa))
+        return skip_main_bulbs_points<double, point_kernel_scalar_f64>;
+
+#if defined(FRACTAL_X86)
+    switch (isa) {
+    case Isa::SSE2: return skip_main_bulbs_points<double, point_kernel_sse2_f64>;
+    case Isa::AVX2: return skip_main_bulbs_points<double, point_kernel_avx2_f64>;
+    case Isa::AVX512: return skip_main_bulbs_points<double, point_kernel_avx512_f64>;
+    default: break;
+    }
+#endif
+    return skip_main_bulbs_points<double, point_kernel_scalar_f64>;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+// Vectorized escape-time kernels, one per instruction set.
+// The best one supported by the running CPU is picked at runtime, so the
+// same binary runs on every x86-64 machine.
+
+enum class Isa
+{
+    Scalar,
+    SSE2,   // 4 points per instruction
+    AVX2,   // 8 points per instruction
+    AVX512, // 16 points per instruction
+};
+
+static constexpr int ISA_COUNT = 4;
+
+const char* isa_name(Isa isa);
+
+// Number of points iterated together by the kernel of isa.
+int isa_lanes(Isa isa);
+
+// Whether the running CPU (and OS) supports isa.
+bool isa_supported(Isa isa);
+
+// Widest instruction set supported by the running CPU.
+Isa best_isa();
+
+// Escape iterations of the count points (cx[i], cy) of one row, written to
+// iter. Same result as calling mandelbrot() on each point.
+// Returns how many points were in the main cardioid or period-2 bulb; they
+// are left out of the vectors so they do not hold lanes for max_iter steps.
+using RowKernel = int (*)(const float* cx, float cy, int count, int max_iter, int* iter);
+
+// Same in double precision, half as many points per instruction.
+using RowKernel64 = int (*)(const double* cx, double cy, int count, int max_iter, int* iter);
+
+// Same for count points (cx[i], cy[i]) anywhere, such as the scattered
+// pixels a render strategy asks for. Points stream through the lanes, each
+// lane taking the next point as soon as its own is done, so the results are
+// those of the row kernels but no lane waits on the slowest of its vector.
+using PointKernel = int (*)(const float* cx, const float* cy, int count, int max_iter, int* iter);
+using PointKernel64 = int (*)(const double* cx, const double* cy, int count, int max_iter, int* iter);
+
+// Kernel for isa, falls back to the scalar one if isa is not available.
+RowKernel row_kernel(Isa isa);
+RowKernel64 row_kernel_f64(Isa isa);
+PointKernel point_kernel(Isa isa);
+PointKernel64 point_kernel_f64(Isa isa);
+
+// Per-ISA kernels iterating every point, only defined when built for x86.
+void row_kernel_sse2(const float* cx, float cy, int count, int max_iter, int* iter);
+void row_kernel_avx2(const float* cx, float cy, int count, int max_iter, int* iter);
+void row_kernel_avx512(const float* cx, float cy, int count, int max_iter, int* iter);
+void row_kernel_sse2_f64(const double* cx, double cy, int count, int max_iter, int* iter);
+void row_kernel_avx2_f64(const double* cx, double cy, int count, int max_iter, int* iter);
+void row_kernel_avx512_f64(const double* cx, double cy, int count, int max_iter, int* iter);
+void point_kernel_sse2(const float* cx, const float* cy, int count, int max_iter, int* iter);
+void point_kernel_avx2(const float* cx, const float* cy, int count, int max_iter, int* iter);
+void point_kernel_avx512(const float* cx, const float* cy, int count, int max_iter, int* iter);
+void point_kernel_sse2_f64(const double* cx, const double* cy, int count, int max_iter, int* iter);
+void point_kernel_avx2_f64(const double* cx, const double* cy, int count, int max_iter, int* iter);
+void point_kernel_avx512_f64(const double* cx, const double* cy, int count, int max_iter, int* iter);
@@ -0,0 +1,305 @@
+#include "simd.h"
+
+#include <immintrin.h>
+
+#include "kernel.h"
+
+// 8 points per instruction, see simd_sse2.cpp.
+static void escape8(const float* cx_in, float cy_in, int max_iter, int* iter_out)
+{
+    const __m256 cx = _mm256_loadu_ps(cx_in);
+    const __m256 cy = _mm256_set1_ps(cy_in);
+    const __m256 four = _mm256_set1_ps(4.0f);
+    const __m256 tolerance = _mm256_set1_ps(cycle_tolerance2<float>());
+
+    __m256 zx = cx;
+    __m256 zy = cy;
+    __m256 sx = zx;
+    __m256 sy = zy;
+    int save_at = 1;
+    __m256i iter = _mm256_set1_epi32(max_iter);
+    __m256 active = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+    for (int i = 0; i < max_iter; ++i) {
+        // Zn+1 = Zn^2 + C
+        const __m256 x = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(zx, zx), _mm256_mul_ps(zy, zy)), cx);
+        const __m256 xy = _mm256_mul_ps(zx, zy);
+        const __m256 y = _mm256_add_ps(_mm256_add_ps(xy, xy), cy);
+        zx = x;
+        zy = y;
+
+        const __m256 mag = _mm256_add_ps(_mm256_mul_ps(zx, zx), _mm256_mul_ps(zy, zy));
+        const __m256 escaped = _mm256_and_ps(_mm256_cmp_ps(mag, four, _CMP_GT_OQ), active);
+        iter = _mm256_blendv_epi8(iter, _mm256_set1_epi32(i), _mm256_castps_si256(escaped));
+        active = _mm256_andnot_ps(escaped, active);
+
+        // Cycling lanes keep max_iter.
+        const __m256 ex = _mm256_sub_ps(zx, sx);
+        const __m256 ey = _mm256_sub_ps(zy, sy);
+        const __m256 dist = _mm256_add_ps(_mm256_mul_ps(ex, ex), _mm256_mul_ps(ey, ey));
+        active = _mm256_andnot_ps(_mm256_cmp_ps(dist, tolerance, _CMP_LT_OQ), active);
+        if (_mm256_movemask_ps(active) == 0)
+            break;
+        if (i == save_at) {
+            sx = zx;
+            sy = zy;
+            save_at *= 2;
+        }
+    }
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(iter_out), iter);
+}
+
+void row_kernel_avx2(const float* cx, float cy, int count, int max_iter, int* iter)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+        escape8(cx + i, cy, max_iter, iter + i);
+
+    if (i < count) {
+        float cx_tail[8] = {};
+        int iter_tail[8];
+        for (int k = 0; k < count - i; ++k)
+            cx_tail[k] = cx[i + k];
+        escape8(cx_tail, cy, max_iter, iter_tail);
+        for (int k = 0; k < count - i; ++k)
+            iter[i + k] = iter_tail[k];
+    }
+}
+
+// Streams points through the lanes, see point_kernel_sse2().
+void point_kernel_avx2(const float* cx, const float* cy, int count, int max_iter, int* iter)
+{
+    if (max_iter <= 0) {
+        for (int i = 0; i < count; ++i)
+            iter[i] = max_iter;
+        return;
+    }
+
+    const __m256 four = _mm256_set1_ps(4.0f);
+    const __m256 tolerance = _mm256_set1_ps(cycle_tolerance2<float>());
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i limit = _mm256_set1_epi32(max_iter);
+
+    alignas(32) float lane_cx[8] = {}, lane_cy[8] = {}, lane_zx[8] = {}, lane_zy[8] = {};
+    alignas(32) float lane_sx[8] = {}, lane_sy[8] = {};
+    alignas(32) int lane_n[8] = {}, lane_save_at[8] = {}, lane_active[8] = {};
+    int lane_point[8] = {-1, -1, -1, -1, -1, -1, -1, -1};
+    __m256 pcx = _mm256_setzero_ps(), pcy = pcx, zx = pcx, zy = pcx, sx = pcx, sy = pcx, active = pcx;
+    __m256i n = _mm256_setzero_si256(), save_at = n;
+    int next = 0;
+    int done = 0xff;
+    int escaped_bits = 0;
+
+    for (;;) {
+        if (done) {
+            _mm256_store_ps(lane_zx, zx);
+            _mm256_store_ps(lane_zy, zy);
+            _mm256_store_ps(lane_sx, sx);
+            _mm256_store_ps(lane_sy, sy);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lane_n), n);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lane_save_at), save_at);
+            int busy = 0;
+            for (int k = 0; k < 8; ++k) {
+                if (done & (1 << k)) {
+                    if (lane_point[k] >= 0)
+                        iter[lane_point[k]] = escaped_bits & (1 << k) ? lane_n[k] - 1 : max_iter;
+                    lane_point[k] = next < count ? next++ : -1;
+                    const bool loaded = lane_point[k] >= 0;
+                    lane_cx[k] = lane_zx[k] = lane_sx[k] = loaded ? cx[lane_point[k]] : 0.0f;
+                    lane_cy[k] = lane_zy[k] = lane_sy[k] = loaded ? cy[lane_point[k]] : 0.0f;
+                    lane_n[k] = 0;
+                    lane_save_at[k] = 1;
+                    lane_active[k] = loaded ? -1 : 0;
+                }
+                busy |= lane_active[k];
+            }
+            if (!busy)
+                break;
+            pcx = _mm256_load_ps(lane_cx);
+            pcy = _mm256_load_ps(lane_cy);
+            zx = _mm256_load_ps(lane_zx);
+            zy = _mm256_load_ps(lane_zy);
+            sx = _mm256_load_ps(lane_sx);
+            sy = _mm256_load_ps(lane_sy);
+            n = _mm256_load_si256(reinterpret_cast<const __m256i*>(lane_n));
+            save_at = _mm256_load_si256(reinterpret_cast<const __m256i*>(lane_save_at));
+            active = _mm256_load_ps(reinterpret_cast<const float*>(lane_active));
+        }
+
+        const __m256 x = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(zx, zx), _mm256_mul_ps(zy, zy)), pcx);
+        const __m256 xy = _mm256_mul_ps(zx, zy);
+        const __m256 y = _mm256_add_ps(_mm256_add_ps(xy, xy), pcy);
+        zx = x;
+        zy = y;
+
+        const __m256 mag = _mm256_add_ps(_mm256_mul_ps(zx, zx), _mm256_mul_ps(zy, zy));
+        const __m256 escaped = _mm256_and_ps(_mm256_cmp_ps(mag, four, _CMP_GT_OQ), active);
+        const __m256 ex = _mm256_sub_ps(zx, sx);
+        const __m256 ey = _mm256_sub_ps(zy, sy);
+        const __m256 dist = _mm256_add_ps(_mm256_mul_ps(ex, ex), _mm256_mul_ps(ey, ey));
+        const __m256 cycled = _mm256_and_ps(_mm256_cmp_ps(dist, tolerance, _CMP_LT_OQ), active);
+
+        const __m256i save = _mm256_cmpeq_epi32(n, save_at);
+        sx = _mm256_blendv_ps(sx, zx, _mm256_castsi256_ps(save));
+        sy = _mm256_blendv_ps(sy, zy, _mm256_castsi256_ps(save));
+        save_at = _mm256_add_epi32(save_at, _mm256_and_si256(save, save_at));
+        n = _mm256_add_epi32(n, one);
+        const __m256 last = _mm256_and_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(n, limit)), active);
+
+        escaped_bits = _mm256_movemask_ps(escaped);
+        done = _mm256_movemask_ps(_mm256_or_ps(_mm256_or_ps(escaped, cycled), last));
+    }
+}
+
+// Double precision, 4 points per instruction.
+static void escape4_f64(const double* cx_in, double cy_in, int max_iter, int* iter_out)
+{
+    const __m256d cx = _mm256_loadu_pd(cx_in);
+    const __m256d cy = _mm256_set1_pd(cy_in);
+    const __m256d four = _mm256_set1_pd(4.0);
+    const __m256d tolerance = _mm256_set1_pd(cycle_tolerance2<double>());
+
+    __m256d zx = cx;
+    __m256d zy = cy;
+    __m256d sx = zx;
+    __m256d sy = zy;
+    int save_at = 1;
+    __m256d active = _mm256_castsi256_pd(_mm256_set1_epi32(-1));
+    for (int k = 0; k < 4; ++k)
+        iter_out[k] = max_iter;
+
+    for (int i = 0; i < max_iter; ++i) {
+        // Zn+1 = Zn^2 + C
+        const __m256d x = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(zx, zx), _mm256_mul_pd(zy, zy)), cx);
+        const __m256d xy = _mm256_mul_pd(zx, zy);
+        const __m256d y = _mm256_add_pd(_mm256_add_pd(xy, xy), cy);
+        zx = x;
+        zy = y;
+
+        const __m256d mag = _mm256_add_pd(_mm256_mul_pd(zx, zx), _mm256_mul_pd(zy, zy));
+        const __m256d escaped = _mm256_and_pd(_mm256_cmp_pd(mag, four, _CMP_GT_OQ), active);
+        const int escaped_bits = _mm256_movemask_pd(escaped);
+        if (escaped_bits) {
+            for (int k = 0; k < 4; ++k) {
+                if (escaped_bits & (1 << k))
+                    iter_out[k] = i;
+            }
+            active = _mm256_andnot_pd(escaped, active);
+        }
+
+        const __m256d ex = _mm256_sub_pd(zx, sx);
+        const __m256d ey = _mm256_sub_pd(zy, sy);
+        const __m256d dist = _mm256_add_pd(_mm256_mul_pd(ex, ex), _mm256_mul_pd(ey, ey));
+        active = _mm256_andnot_pd(_mm256_cmp_pd(dist, tolerance, _CMP_LT_OQ), active);
+        if (_mm256_movemask_pd(active) == 0)
+            break;
+        if (i == save_at) {
+            sx = zx;
+            sy = zy;
+            save_at *= 2;
+        }
+    }
+}
+
+void row_kernel_avx2_f64(const double* cx, double cy, int count, int max_iter, int* iter)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        escape4_f64(cx + i, cy, max_iter, iter + i);
+
+    if (i < count) {
+        double cx_tail[4] = {};
+        int iter_tail[4];
+        for (int k = 0; k < count - i; ++k)
+            cx_tail[k] = cx[i + k];
+        escape4_f64(cx_tail, cy, max_iter, iter_tail);
+        for (int k = 0; k < count - i; ++k)
+            iter[i + k] = iter_tail[k];
+    }
+}
+
+// Streams points through the lanes, see point_kernel_sse2_f64().
+void point_kernel_avx2_f64(const double* cx, const double* cy, int count, int max_iter, int* iter)
+{
+    if (max_iter <= 0) {
+        for (int i = 0; i < count; ++i)
+            iter[i] = max_iter;
+        return;
+    }
+
+    const __m256d four = _mm256_set1_pd(4.0);
+    const __m256d tolerance = _mm256_set1_pd(cycle_tolerance2<double>());
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d limit = _mm256_set1_pd(max_iter);
+
+    alignas(32) double lane_cx[4] = {}, lane_cy[4] = {}, lane_zx[4] = {}, lane_zy[4] = {};
+    alignas(32) double lane_sx[4] = {}, lane_sy[4] = {}, lane_n[4] = {}, lane_save_at[4] = {};
+    alignas(32) long long lane_active[4] = {};
+    int lane_point[4] = {-1, -1, -1, -1};
+    __m256d pcx = _mm256_setzero_pd(), pcy = pcx, zx = pcx, zy = pcx, sx = pcx, sy = pcx, active = pcx;
+    __m256d n = pcx, save_at = pcx;
+    int next = 0;
+    int done = 0xf;
+    int escaped_bits = 0;
+
+    for (;;) {
+        if (done) {
+            _mm256_store_pd(lane_zx, zx);
+            _mm256_store_pd(lane_zy, zy);
+            _mm256_store_pd(lane_sx, sx);
+            _mm256_store_pd(lane_sy, sy);
+            _mm256_store_pd(lane_n, n);
+            _mm256_store_pd(lane_save_at, save_at);
+            long long busy = 0;
+            for (int k = 0; k < 4; ++k) {
+                if (done & (1 << k)) {
+                    if (lane_point[k] >= 0)
+                        iter[lane_point[k]] = escaped_bits & (1 << k) ? static_cast<int>(lane_n[k]) - 1 : max_iter;
+                    lane_point[k] = next < count ? next++ : -1;
+                    const bool loaded = lane_point[k] >= 0;
+                    lane_cx[k] = lane_zx[k] = lane_sx[k] = loaded ? cx[lane_point[k]] : 0.0;
+                    lane_cy[k] = lane_zy[k] = lane_sy[k] = loaded ? cy[lane_point[k]] : 0.0;
+                    lane_n[k] = 0.0;
+                    lane_save_at[k] = 1.0;
+                    lane_active[k] = loaded ? -1 : 0;
+                }
+                busy |= lane_active[k];
+            }
+            if (!busy)
+                break;
+            pcx = _mm256_load_pd(lane_cx);
+            pcy = _mm256_load_pd(lane_cy);
+            zx = _mm256_load_pd(lane_zx);
+            zy = _mm256_load_pd(lane_zy);
+            sx = _mm256_load_pd(lane_sx);
+            sy = _mm256_load_pd(lane_sy);
+            n = _mm256_load_pd(lane_n);
+            save_at = _mm256_load_pd(lane_save_at);
+            active = _mm256_load_pd(reinterpret_cast<const double*>(lane_active));
+        }
+
+        const __m256d x = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(zx, zx), _mm256_mul_pd(zy, zy)), pcx);
+        const __m256d xy = _mm256_mul_pd(zx, zy);
+        const __m256d y = _mm256_add_pd(_mm256_add_pd(xy, xy), pcy);
+        zx = x;
+        zy = y;
+
+        const __m256d mag = _mm256_add_pd(_mm256_mul_pd(zx, zx), _mm256_mul_pd(zy, zy));
+        const __m256d escaped = _mm256_and_pd(_mm256_cmp_pd(mag, four, _CMP_GT_OQ), active);
+        const __m256d ex = _mm256_sub_pd(zx, sx);
+        const __m256d ey = _mm256_sub_pd(zy, sy);
+        const __m256d dist = _mm256_add_pd(_mm256_mul_pd(ex, ex), _mm256_mul_pd(ey, ey));
+        const __m256d cycled = _mm256_and_pd(_mm256_cmp_pd(dist, tolerance, _CMP_LT_OQ), active);
+
+        const __m256d save = _mm256_cmp_pd(n, save_at, _CMP_EQ_OQ);
+        sx = _mm256_blendv_pd(sx, zx, save);
+        sy = _mm256_blendv_pd(sy, zy, save);
+        save_at = _mm256_add_pd(save_at, _mm256_and_pd(save, save_at));
+        n = _mm256_add_pd(n, one);
+        const __m256d last = _mm256_and_pd(_mm256_cmp_pd(n, limit, _CMP_EQ_OQ), active);
+
+        escaped_bits = _mm256_movemask_pd(escaped);
+        done = _mm256_movemask_pd(_mm256_or_pd(_mm256_or_pd(escaped, cycled), last));
+    }
+}
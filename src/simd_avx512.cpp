@@ -0,0 +1,269 @@
+#include "simd.h"
+
+#include <immintrin.h>
+
+#include "kernel.h"
+
+// 16 points per instruction, see simd_sse2.cpp.
+// The tail of the row uses masked loads and stores instead of a copy.
+static void escape16(const float* cx_in, float cy_in, int max_iter, int* iter_out, __mmask16 lanes)
+{
+    const __m512 cx = _mm512_maskz_loadu_ps(lanes, cx_in);
+    const __m512 cy = _mm512_set1_ps(cy_in);
+    const __m512 four = _mm512_set1_ps(4.0f);
+    const __m512 tolerance = _mm512_set1_ps(cycle_tolerance2<float>());
+
+    __m512 zx = cx;
+    __m512 zy = cy;
+    __m512 sx = zx;
+    __m512 sy = zy;
+    int save_at = 1;
+    __m512i iter = _mm512_set1_epi32(max_iter);
+    __mmask16 active = lanes;
+
+    for (int i = 0; i < max_iter; ++i) {
+        // Zn+1 = Zn^2 + C
+        const __m512 x = _mm512_add_ps(_mm512_sub_ps(_mm512_mul_ps(zx, zx), _mm512_mul_ps(zy, zy)), cx);
+        const __m512 xy = _mm512_mul_ps(zx, zy);
+        const __m512 y = _mm512_add_ps(_mm512_add_ps(xy, xy), cy);
+        zx = x;
+        zy = y;
+
+        const __m512 mag = _mm512_add_ps(_mm512_mul_ps(zx, zx), _mm512_mul_ps(zy, zy));
+        const __mmask16 escaped = _mm512_mask_cmp_ps_mask(active, mag, four, _CMP_GT_OQ);
+        iter = _mm512_mask_mov_epi32(iter, escaped, _mm512_set1_epi32(i));
+        active = static_cast<__mmask16>(active & ~escaped);
+
+        // Cycling lanes keep max_iter.
+        const __m512 ex = _mm512_sub_ps(zx, sx);
+        const __m512 ey = _mm512_sub_ps(zy, sy);
+        const __m512 dist = _mm512_add_ps(_mm512_mul_ps(ex, ex), _mm512_mul_ps(ey, ey));
+        active = static_cast<__mmask16>(active & ~_mm512_mask_cmp_ps_mask(active, dist, tolerance, _CMP_LT_OQ));
+        if (active == 0)
+            break;
+        if (i == save_at) {
+            sx = zx;
+            sy = zy;
+            save_at *= 2;
+        }
+    }
+
+    _mm512_mask_storeu_epi32(iter_out, lanes, iter);
+}
+
+void row_kernel_avx512(const float* cx, float cy, int count, int max_iter, int* iter)
+{
+    int i = 0;
+    for (; i + 16 <= count; i += 16)
+        escape16(cx + i, cy, max_iter, iter + i, 0xffff);
+
+    if (i < count) {
+        const __mmask16 lanes = static_cast<__mmask16>((1u << (count - i)) - 1);
+        escape16(cx + i, cy, max_iter, iter + i, lanes);
+    }
+}
+
+// Streams points through the lanes, see point_kernel_sse2(). Lanes take
+// their next points with expanding loads and store results with a scatter,
+// without going through memory.
+void point_kernel_avx512(const float* cx, const float* cy, int count, int max_iter, int* iter)
+{
+    if (max_iter <= 0) {
+        for (int i = 0; i < count; ++i)
+            iter[i] = max_iter;
+        return;
+    }
+
+    const __m512 four = _mm512_set1_ps(4.0f);
+    const __m512 tolerance = _mm512_set1_ps(cycle_tolerance2<float>());
+    const __m512i one = _mm512_set1_epi32(1);
+    const __m512i limit = _mm512_set1_epi32(max_iter);
+    const __m512i lane_offset = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+    __m512 pcx = _mm512_setzero_ps(), pcy = pcx, zx = pcx, zy = pcx, sx = pcx, sy = pcx;
+    __m512i n = _mm512_setzero_si512(), save_at = n, point = n;
+    __mmask16 active = 0;
+    __mmask16 done = 0xffff;
+    int next = 0;
+
+    for (;;) {
+        if (done && next < count) {
+            // The lowest idle lanes take the next points, in order.
+            __mmask16 load = done;
+            while (__builtin_popcount(load) > count - next)
+                load = static_cast<__mmask16>(load & ~(1u << (31 - __builtin_clz(load))));
+            pcx = _mm512_mask_expandloadu_ps(pcx, load, cx + next);
+            pcy = _mm512_mask_expandloadu_ps(pcy, load, cy + next);
+            point = _mm512_mask_expand_epi32(point, load, _mm512_add_epi32(lane_offset, _mm512_set1_epi32(next)));
+            zx = _mm512_mask_mov_ps(zx, load, pcx);
+            zy = _mm512_mask_mov_ps(zy, load, pcy);
+            sx = _mm512_mask_mov_ps(sx, load, pcx);
+            sy = _mm512_mask_mov_ps(sy, load, pcy);
+            n = _mm512_mask_mov_epi32(n, load, _mm512_setzero_si512());
+            save_at = _mm512_mask_mov_epi32(save_at, load, one);
+            active = static_cast<__mmask16>(active | load);
+            next += __builtin_popcount(load);
+        }
+        if (active == 0)
+            break;
+
+        const __m512 x = _mm512_add_ps(_mm512_sub_ps(_mm512_mul_ps(zx, zx), _mm512_mul_ps(zy, zy)), pcx);
+        const __m512 xy = _mm512_mul_ps(zx, zy);
+        const __m512 y = _mm512_add_ps(_mm512_add_ps(xy, xy), pcy);
+        zx = x;
+        zy = y;
+
+        const __m512 mag = _mm512_add_ps(_mm512_mul_ps(zx, zx), _mm512_mul_ps(zy, zy));
+        const __mmask16 escaped = _mm512_mask_cmp_ps_mask(active, mag, four, _CMP_GT_OQ);
+        const __m512 ex = _mm512_sub_ps(zx, sx);
+        const __m512 ey = _mm512_sub_ps(zy, sy);
+        const __m512 dist = _mm512_add_ps(_mm512_mul_ps(ex, ex), _mm512_mul_ps(ey, ey));
+        const __mmask16 cycled = _mm512_mask_cmp_ps_mask(active, dist, tolerance, _CMP_LT_OQ);
+
+        const __mmask16 save = _mm512_cmpeq_epi32_mask(n, save_at);
+        sx = _mm512_mask_mov_ps(sx, save, zx);
+        sy = _mm512_mask_mov_ps(sy, save, zy);
+        save_at = _mm512_mask_add_epi32(save_at, save, save_at, save_at);
+        const __m512i result = _mm512_mask_mov_epi32(limit, escaped, n);
+        n = _mm512_add_epi32(n, one);
+
+        done = static_cast<__mmask16>(escaped | cycled | _mm512_mask_cmpeq_epi32_mask(active, n, limit));
+        if (done) {
+            _mm512_mask_i32scatter_epi32(iter, done, point, result, 4);
+            active = static_cast<__mmask16>(active & ~done);
+        }
+    }
+}
+
+// Double precision, 8 points per instruction.
+static void escape8_f64(const double* cx_in, double cy_in, int max_iter, int* iter_out, __mmask8 lanes)
+{
+    const __m512d cx = _mm512_maskz_loadu_pd(lanes, cx_in);
+    const __m512d cy = _mm512_set1_pd(cy_in);
+    const __m512d four = _mm512_set1_pd(4.0);
+    const __m512d tolerance = _mm512_set1_pd(cycle_tolerance2<double>());
+
+    __m512d zx = cx;
+    __m512d zy = cy;
+    __m512d sx = zx;
+    __m512d sy = zy;
+    int save_at = 1;
+    __mmask8 active = lanes;
+    for (int k = 0; k < 8; ++k) {
+        if (lanes & (1 << k))
+            iter_out[k] = max_iter;
+    }
+
+    for (int i = 0; i < max_iter; ++i) {
+        // Zn+1 = Zn^2 + C
+        const __m512d x = _mm512_add_pd(_mm512_sub_pd(_mm512_mul_pd(zx, zx), _mm512_mul_pd(zy, zy)), cx);
+        const __m512d xy = _mm512_mul_pd(zx, zy);
+        const __m512d y = _mm512_add_pd(_mm512_add_pd(xy, xy), cy);
+        zx = x;
+        zy = y;
+
+        const __m512d mag = _mm512_add_pd(_mm512_mul_pd(zx, zx), _mm512_mul_pd(zy, zy));
+        const __mmask8 escaped = _mm512_mask_cmp_pd_mask(active, mag, four, _CMP_GT_OQ);
+        if (escaped) {
+            for (int k = 0; k < 8; ++k) {
+                if (escaped & (1 << k))
+                    iter_out[k] = i;
+            }
+            active = static_cast<__mmask8>(active & ~escaped);
+        }
+
+        const __m512d ex = _mm512_sub_pd(zx, sx);
+        const __m512d ey = _mm512_sub_pd(zy, sy);
+        const __m512d dist = _mm512_add_pd(_mm512_mul_pd(ex, ex), _mm512_mul_pd(ey, ey));
+        active = static_cast<__mmask8>(active & ~_mm512_mask_cmp_pd_mask(active, dist, tolerance, _CMP_LT_OQ));
+        if (active == 0)
+            break;
+        if (i == save_at) {
+            sx = zx;
+            sy = zy;
+            save_at *= 2;
+        }
+    }
+}
+
+void row_kernel_avx512_f64(const double* cx, double cy, int count, int max_iter, int* iter)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+        escape8_f64(cx + i, cy, max_iter, iter + i, 0xff);
+
+    if (i < count) {
+        const __mmask8 lanes = static_cast<__mmask8>((1u << (count - i)) - 1);
+        escape8_f64(cx + i, cy, max_iter, iter + i, lanes);
+    }
+}
+
+// Streams points through the lanes, see point_kernel_avx512().
+void point_kernel_avx512_f64(const double* cx, const double* cy, int count, int max_iter, int* iter)
+{
+    if (max_iter <= 0) {
+        for (int i = 0; i < count; ++i)
+            iter[i] = max_iter;
+        return;
+    }
+
+    const __m512d four = _mm512_set1_pd(4.0);
+    const __m512d tolerance = _mm512_set1_pd(cycle_tolerance2<double>());
+    const __m512i one = _mm512_set1_epi64(1);
+    const __m512i limit = _mm512_set1_epi64(max_iter);
+    const __m512i lane_offset = _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+
+    __m512d pcx = _mm512_setzero_pd(), pcy = pcx, zx = pcx, zy = pcx, sx = pcx, sy = pcx;
+    __m512i n = _mm512_setzero_si512(), save_at = n, point = n;
+    __mmask8 active = 0;
+    __mmask8 done = 0xff;
+    int next = 0;
+
+    for (;;) {
+        if (done && next < count) {
+            __mmask8 load = done;
+            while (__builtin_popcount(load) > count - next)
+                load = static_cast<__mmask8>(load & ~(1u << (31 - __builtin_clz(load))));
+            pcx = _mm512_mask_expandloadu_pd(pcx, load, cx + next);
+            pcy = _mm512_mask_expandloadu_pd(pcy, load, cy + next);
+            point = _mm512_mask_expand_epi64(point, load, _mm512_add_epi64(lane_offset, _mm512_set1_epi64(next)));
+            zx = _mm512_mask_mov_pd(zx, load, pcx);
+            zy = _mm512_mask_mov_pd(zy, load, pcy);
+            sx = _mm512_mask_mov_pd(sx, load, pcx);
+            sy = _mm512_mask_mov_pd(sy, load, pcy);
+            n = _mm512_mask_mov_epi64(n, load, _mm512_setzero_si512());
+            save_at = _mm512_mask_mov_epi64(save_at, load, one);
+            active = static_cast<__mmask8>(active | load);
+            next += __builtin_popcount(load);
+        }
+        if (active == 0)
+            break;
+
+        const __m512d x = _mm512_add_pd(_mm512_sub_pd(_mm512_mul_pd(zx, zx), _mm512_mul_pd(zy, zy)), pcx);
+        const __m512d xy = _mm512_mul_pd(zx, zy);
+        const __m512d y = _mm512_add_pd(_mm512_add_pd(xy, xy), pcy);
+        zx = x;
+        zy = y;
+
+        const __m512d mag = _mm512_add_pd(_mm512_mul_pd(zx, zx), _mm512_mul_pd(zy, zy));
+        const __mmask8 escaped = _mm512_mask_cmp_pd_mask(active, mag, four, _CMP_GT_OQ);
+        const __m512d ex = _mm512_sub_pd(zx, sx);
+        const __m512d ey = _mm512_sub_pd(zy, sy);
+        const __m512d dist = _mm512_add_pd(_mm512_mul_pd(ex, ex), _mm512_mul_pd(ey, ey));
+        const __mmask8 cycled = _mm512_mask_cmp_pd_mask(active, dist, tolerance, _CMP_LT_OQ);
+
+        const __mmask8 save = _mm512_cmpeq_epi64_mask(n, save_at);
+        sx = _mm512_mask_mov_pd(sx, save, zx);
+        sy = _mm512_mask_mov_pd(sy, save, zy);
+        save_at = _mm512_mask_add_epi64(save_at, save, save_at, save_at);
+        const __m512i result = _mm512_mask_mov_epi64(limit, escaped, n);
+        n = _mm512_add_epi64(n, one);
+
+        done = static_cast<__mmask8>(escaped | cycled | _mm512_mask_cmpeq_epi64_mask(active, n, limit));
+        if (done) {
+            _mm512_mask_i64scatter_epi32(iter, done, point,
+                                         _mm512_mask_cvtepi64_epi32(_mm256_setzero_si256(), done, result), 4);
+            active = static_cast<__mmask8>(active & ~done);
+        }
+    }
+}
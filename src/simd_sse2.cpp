@@ -0,0 +1,315 @@
+#include "simd.h"
+
+#include <emmintrin.h>
+
+#include "kernel.h"
+
+// 4 points per instruction. Lanes retire through a mask as they escape or
+// fall in a cycle, the loop ends when every lane retired or max_iter is
+// reached. Same cycle check as escape_time(), on every lane at once.
+static void escape4(const float* cx_in, float cy_in, int max_iter, int* iter_out)
+{
+    const __m128 cx = _mm_loadu_ps(cx_in);
+    const __m128 cy = _mm_set1_ps(cy_in);
+    const __m128 four = _mm_set1_ps(4.0f);
+    const __m128 tolerance = _mm_set1_ps(cycle_tolerance2<float>());
+
+    __m128 zx = cx;
+    __m128 zy = cy;
+    __m128 sx = zx;
+    __m128 sy = zy;
+    int save_at = 1;
+    __m128i iter = _mm_set1_epi32(max_iter);
+    __m128 active = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+    for (int i = 0; i < max_iter; ++i) {
+        // Zn+1 = Zn^2 + C
+        const __m128 x = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(zx, zx), _mm_mul_ps(zy, zy)), cx);
+        const __m128 xy = _mm_mul_ps(zx, zy);
+        const __m128 y = _mm_add_ps(_mm_add_ps(xy, xy), cy);
+        zx = x;
+        zy = y;
+
+        const __m128 mag = _mm_add_ps(_mm_mul_ps(zx, zx), _mm_mul_ps(zy, zy));
+        const __m128 escaped = _mm_and_ps(_mm_cmpgt_ps(mag, four), active);
+        const __m128i escaped_i = _mm_castps_si128(escaped);
+        iter = _mm_or_si128(_mm_andnot_si128(escaped_i, iter),
+                            _mm_and_si128(escaped_i, _mm_set1_epi32(i)));
+        active = _mm_andnot_ps(escaped, active);
+
+        // Cycling lanes keep max_iter.
+        const __m128 ex = _mm_sub_ps(zx, sx);
+        const __m128 ey = _mm_sub_ps(zy, sy);
+        const __m128 dist = _mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey));
+        active = _mm_andnot_ps(_mm_cmplt_ps(dist, tolerance), active);
+        if (_mm_movemask_ps(active) == 0)
+            break;
+        if (i == save_at) {
+            sx = zx;
+            sy = zy;
+            save_at *= 2;
+        }
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(iter_out), iter);
+}
+
+void row_kernel_sse2(const float* cx, float cy, int count, int max_iter, int* iter)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        escape4(cx + i, cy, max_iter, iter + i);
+
+    if (i < count) {
+        float cx_tail[4] = {};
+        int iter_tail[4];
+        for (int k = 0; k < count - i; ++k)
+            cx_tail[k] = cx[i + k];
+        escape4(cx_tail, cy, max_iter, iter_tail);
+        for (int k = 0; k < count - i; ++k)
+            iter[i + k] = iter_tail[k];
+    }
+}
+
+// Points anywhere, as strategies ask for them, stream through the lanes
+// instead: as soon as the point of a lane escapes, falls in a cycle or
+// reaches max_iter, the lane takes the next one. No lane idles until the
+// slowest of its vector is done, which scattered points, with no neighbour
+// of similar count to share a vector with, would make them do most of the
+// time. Each lane keeps its own iteration count and cycle check schedule,
+// so every point gets the same result as in escape4(). Lanes change point
+// through memory, once per point.
+void point_kernel_sse2(const float* cx, const float* cy, int count, int max_iter, int* iter)
+{
+    if (max_iter <= 0) {
+        for (int i = 0; i < count; ++i)
+            iter[i] = max_iter;
+        return;
+    }
+
+    const __m128 four = _mm_set1_ps(4.0f);
+    const __m128 tolerance = _mm_set1_ps(cycle_tolerance2<float>());
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i limit = _mm_set1_epi32(max_iter);
+
+    alignas(16) float lane_cx[4] = {}, lane_cy[4] = {}, lane_zx[4] = {}, lane_zy[4] = {};
+    alignas(16) float lane_sx[4] = {}, lane_sy[4] = {};
+    alignas(16) int lane_n[4] = {}, lane_save_at[4] = {}, lane_active[4] = {};
+    int lane_point[4] = {-1, -1, -1, -1};
+    __m128 pcx = _mm_setzero_ps(), pcy = pcx, zx = pcx, zy = pcx, sx = pcx, sy = pcx, active = pcx;
+    __m128i n = _mm_setzero_si128(), save_at = n;
+    int next = 0;
+    int done = 0xf;
+    int escaped_bits = 0;
+
+    for (;;) {
+        if (done) {
+            _mm_store_ps(lane_zx, zx);
+            _mm_store_ps(lane_zy, zy);
+            _mm_store_ps(lane_sx, sx);
+            _mm_store_ps(lane_sy, sy);
+            _mm_store_si128(reinterpret_cast<__m128i*>(lane_n), n);
+            _mm_store_si128(reinterpret_cast<__m128i*>(lane_save_at), save_at);
+            int busy = 0;
+            for (int k = 0; k < 4; ++k) {
+                if (done & (1 << k)) {
+                    // Escaped at the iteration just counted.
+                    if (lane_point[k] >= 0)
+                        iter[lane_point[k]] = escaped_bits & (1 << k) ? lane_n[k] - 1 : max_iter;
+                    lane_point[k] = next < count ? next++ : -1;
+                    const bool loaded = lane_point[k] >= 0;
+                    lane_cx[k] = lane_zx[k] = lane_sx[k] = loaded ? cx[lane_point[k]] : 0.0f;
+                    lane_cy[k] = lane_zy[k] = lane_sy[k] = loaded ? cy[lane_point[k]] : 0.0f;
+                    lane_n[k] = 0;
+                    lane_save_at[k] = 1;
+                    lane_active[k] = loaded ? -1 : 0;
+                }
+                busy |= lane_active[k];
+            }
+            if (!busy)
+                break;
+            pcx = _mm_load_ps(lane_cx);
+            pcy = _mm_load_ps(lane_cy);
+            zx = _mm_load_ps(lane_zx);
+            zy = _mm_load_ps(lane_zy);
+            sx = _mm_load_ps(lane_sx);
+            sy = _mm_load_ps(lane_sy);
+            n = _mm_load_si128(reinterpret_cast<const __m128i*>(lane_n));
+            save_at = _mm_load_si128(reinterpret_cast<const __m128i*>(lane_save_at));
+            active = _mm_load_ps(reinterpret_cast<const float*>(lane_active));
+        }
+
+        const __m128 x = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(zx, zx), _mm_mul_ps(zy, zy)), pcx);
+        const __m128 xy = _mm_mul_ps(zx, zy);
+        const __m128 y = _mm_add_ps(_mm_add_ps(xy, xy), pcy);
+        zx = x;
+        zy = y;
+
+        const __m128 mag = _mm_add_ps(_mm_mul_ps(zx, zx), _mm_mul_ps(zy, zy));
+        const __m128 escaped = _mm_and_ps(_mm_cmpgt_ps(mag, four), active);
+        const __m128 ex = _mm_sub_ps(zx, sx);
+        const __m128 ey = _mm_sub_ps(zy, sy);
+        const __m128 dist = _mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey));
+        const __m128 cycled = _mm_and_ps(_mm_cmplt_ps(dist, tolerance), active);
+
+        const __m128 save = _mm_castsi128_ps(_mm_cmpeq_epi32(n, save_at));
+        sx = _mm_or_ps(_mm_andnot_ps(save, sx), _mm_and_ps(save, zx));
+        sy = _mm_or_ps(_mm_andnot_ps(save, sy), _mm_and_ps(save, zy));
+        save_at = _mm_add_epi32(save_at, _mm_and_si128(_mm_castps_si128(save), save_at));
+        n = _mm_add_epi32(n, one);
+        const __m128 last = _mm_and_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(n, limit)), active);
+
+        escaped_bits = _mm_movemask_ps(escaped);
+        done = _mm_movemask_ps(_mm_or_ps(_mm_or_ps(escaped, cycled), last));
+    }
+}
+
+// Double precision, 2 points per instruction.
+static void escape2(const double* cx_in, double cy_in, int max_iter, int* iter_out)
+{
+    const __m128d cx = _mm_loadu_pd(cx_in);
+    const __m128d cy = _mm_set1_pd(cy_in);
+    const __m128d four = _mm_set1_pd(4.0);
+    const __m128d tolerance = _mm_set1_pd(cycle_tolerance2<double>());
+
+    __m128d zx = cx;
+    __m128d zy = cy;
+    __m128d sx = zx;
+    __m128d sy = zy;
+    int save_at = 1;
+    __m128d active = _mm_castsi128_pd(_mm_set1_epi32(-1));
+    iter_out[0] = iter_out[1] = max_iter;
+
+    for (int i = 0; i < max_iter; ++i) {
+        // Zn+1 = Zn^2 + C
+        const __m128d x = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(zx, zx), _mm_mul_pd(zy, zy)), cx);
+        const __m128d xy = _mm_mul_pd(zx, zy);
+        const __m128d y = _mm_add_pd(_mm_add_pd(xy, xy), cy);
+        zx = x;
+        zy = y;
+
+        const __m128d mag = _mm_add_pd(_mm_mul_pd(zx, zx), _mm_mul_pd(zy, zy));
+        const __m128d escaped = _mm_and_pd(_mm_cmpgt_pd(mag, four), active);
+        const int escaped_bits = _mm_movemask_pd(escaped);
+        if (escaped_bits) {
+            for (int k = 0; k < 2; ++k) {
+                if (escaped_bits & (1 << k))
+                    iter_out[k] = i;
+            }
+            active = _mm_andnot_pd(escaped, active);
+        }
+
+        const __m128d ex = _mm_sub_pd(zx, sx);
+        const __m128d ey = _mm_sub_pd(zy, sy);
+        const __m128d dist = _mm_add_pd(_mm_mul_pd(ex, ex), _mm_mul_pd(ey, ey));
+        active = _mm_andnot_pd(_mm_cmplt_pd(dist, tolerance), active);
+        if (_mm_movemask_pd(active) == 0)
+            break;
+        if (i == save_at) {
+            sx = zx;
+            sy = zy;
+            save_at *= 2;
+        }
+    }
+}
+
+void row_kernel_sse2_f64(const double* cx, double cy, int count, int max_iter, int* iter)
+{
+    int i = 0;
+    for (; i + 2 <= count; i += 2)
+        escape2(cx + i, cy, max_iter, iter + i);
+
+    if (i < count) {
+        const double cx_tail[2] = {cx[i], 0.0};
+        int iter_tail[2];
+        escape2(cx_tail, cy, max_iter, iter_tail);
+        iter[i] = iter_tail[0];
+    }
+}
+
+// Same streaming as point_kernel_sse2(), 2 points at a time. Iteration
+// counts are kept as doubles, exact far past any max_iter, as SSE2 has no
+// 64-bit integer compare.
+void point_kernel_sse2_f64(const double* cx, const double* cy, int count, int max_iter, int* iter)
+{
+    if (max_iter <= 0) {
+        for (int i = 0; i < count; ++i)
+            iter[i] = max_iter;
+        return;
+    }
+
+    const __m128d four = _mm_set1_pd(4.0);
+    const __m128d tolerance = _mm_set1_pd(cycle_tolerance2<double>());
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d limit = _mm_set1_pd(max_iter);
+
+    alignas(16) double lane_cx[2] = {}, lane_cy[2] = {}, lane_zx[2] = {}, lane_zy[2] = {};
+    alignas(16) double lane_sx[2] = {}, lane_sy[2] = {}, lane_n[2] = {}, lane_save_at[2] = {};
+    alignas(16) long long lane_active[2] = {};
+    int lane_point[2] = {-1, -1};
+    __m128d pcx = _mm_setzero_pd(), pcy = pcx, zx = pcx, zy = pcx, sx = pcx, sy = pcx, active = pcx;
+    __m128d n = pcx, save_at = pcx;
+    int next = 0;
+    int done = 0x3;
+    int escaped_bits = 0;
+
+    for (;;) {
+        if (done) {
+            _mm_store_pd(lane_zx, zx);
+            _mm_store_pd(lane_zy, zy);
+            _mm_store_pd(lane_sx, sx);
+            _mm_store_pd(lane_sy, sy);
+            _mm_store_pd(lane_n, n);
+            _mm_store_pd(lane_save_at, save_at);
+            long long busy = 0;
+            for (int k = 0; k < 2; ++k) {
+                if (done & (1 << k)) {
+                    if (lane_point[k] >= 0)
+                        iter[lane_point[k]] = escaped_bits & (1 << k) ? static_cast<int>(lane_n[k]) - 1 : max_iter;
+                    lane_point[k] = next < count ? next++ : -1;
+                    const bool loaded = lane_point[k] >= 0;
+                    lane_cx[k] = lane_zx[k] = lane_sx[k] = loaded ? cx[lane_point[k]] : 0.0;
+                    lane_cy[k] = lane_zy[k] = lane_sy[k] = loaded ? cy[lane_point[k]] : 0.0;
+                    lane_n[k] = 0.0;
+                    lane_save_at[k] = 1.0;
+                    lane_active[k] = loaded ? -1 : 0;
+                }
+                busy |= lane_active[k];
+            }
+            if (!busy)
+                break;
+            pcx = _mm_load_pd(lane_cx);
+            pcy = _mm_load_pd(lane_cy);
+            zx = _mm_load_pd(lane_zx);
+            zy = _mm_load_pd(lane_zy);
+            sx = _mm_load_pd(lane_sx);
+            sy = _mm_load_pd(lane_sy);
+            n = _mm_load_pd(lane_n);
+            save_at = _mm_load_pd(lane_save_at);
+            active = _mm_load_pd(reinterpret_cast<const double*>(lane_active));
+        }
+
+        const __m128d x = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(zx, zx), _mm_mul_pd(zy, zy)), pcx);
+        const __m128d xy = _mm_mul_pd(zx, zy);
+        const __m128d y = _mm_add_pd(_mm_add_pd(xy, xy), pcy);
+        zx = x;
+        zy = y;
+
+        const __m128d mag = _mm_add_pd(_mm_mul_pd(zx, zx), _mm_mul_pd(zy, zy));
+        const __m128d escaped = _mm_and_pd(_mm_cmpgt_pd(mag, four), active);
+        const __m128d ex = _mm_sub_pd(zx, sx);
+        const __m128d ey = _mm_sub_pd(zy, sy);
+        const __m128d dist = _mm_add_pd(_mm_mul_pd(ex, ex), _mm_mul_pd(ey, ey));
+        const __m128d cycled = _mm_and_pd(_mm_cmplt_pd(dist, tolerance), active);
+
+        const __m128d save = _mm_cmpeq_pd(n, save_at);
+        sx = _mm_or_pd(_mm_andnot_pd(save, sx), _mm_and_pd(save, zx));
+        sy = _mm_or_pd(_mm_andnot_pd(save, sy), _mm_and_pd(save, zy));
+        save_at = _mm_add_pd(save_at, _mm_and_pd(save, save_at));
+        n = _mm_add_pd(n, one);
+        const __m128d last = _mm_and_pd(_mm_cmpeq_pd(n, limit), active);
+
+        escaped_bits = _mm_movemask_pd(escaped);
+        done = _mm_movemask_pd(_mm_or_pd(_mm_or_pd(escaped, cycled), last));
+    }
+}
@@ -0,0 +1,272 @@
+#include "strategy.h"
+
+#include <vector>
+
+const char* strategy_name(Strategy strategy)
+{
+    switch (strategy) {
+    case Strategy::Subdivision: return "subdivision";
+    case Strategy::BoundaryTrace: return "boundary-trace";
+    default: return "brute-force";
+    }
+}
+
+namespace
+{
+
+// Pixels of one tile, in coordinates local to it, and which of them hold a
+// computed or filled value. Pixels to compute are requested first and
+// computed together on flush(), so the kernel gets whole vectors of them
+// even when they lie down a column or scattered over the tile.
+class TileState
+{
+public:
+    TileState(const Tile& tile, int width, const PixelKernel& kernel, int* iter,
+              const unsigned char* keep)
+        : tile_(tile), width_(width), kernel_(kernel), iter_(iter),
+          known_(static_cast<size_t>(tile.width) * tile.height, UNKNOWN)
+    {
+        if (!keep)
+            return;
+        for (int y = 0; y < tile.height; ++y) {
+            for (int x = 0; x < tile.width; ++x) {
+                if (keep[static_cast<size_t>(tile.y0 + y) * width + tile.x0 + x])
+                    known_[static_cast<size_t>(y) * tile.width + x] = KNOWN;
+            }
+        }
+    }
+
+    int& at(int x, int y)
+    {
+        return iter_[static_cast<size_t>(tile_.y0 + y) * width_ + tile_.x0 + x];
+    }
+
+    // Compute (x, y) on the next flush(), unless it is known or requested
+    // already. Returns whether it was not.
+    bool request(int x, int y)
+    {
+        char& state = known_[static_cast<size_t>(y) * tile_.width + x];
+        if (state != UNKNOWN)
+            return false;
+        state = REQUESTED;
+        requested_x_.push_back(tile_.x0 + x);
+        requested_y_.push_back(tile_.y0 + y);
+        return true;
+    }
+
+    // Compute every pixel requested since the last flush, in one call.
+    void flush()
+    {
+        const int count = static_cast<int>(requested_x_.size());
+        if (count == 0)
+            return;
+        results_.resize(count);
+        kernel_(requested_x_.data(), requested_y_.data(), count, results_.data());
+        for (int i = 0; i < count; ++i) {
+            const int x = requested_x_[i] - tile_.x0;
+            const int y = requested_y_[i] - tile_.y0;
+            at(x, y) = results_[i];
+            mark(x, y);
+        }
+        computed_ += count;
+        requested_x_.clear();
+        requested_y_.clear();
+    }
+
+    void fill(int x0, int y0, int x1, int y1, int value)
+    {
+        for (int y = y0; y <= y1; ++y) {
+            for (int x = x0; x <= x1; ++x) {
+                at(x, y) = value;
+                mark(x, y);
+            }
+        }
+    }
+
+    long long computed() const { return computed_; }
+
+    bool known(int x, int y) const { return known_[static_cast<size_t>(y) * tile_.width + x] == KNOWN; }
+
+private:
+    enum : char
+    {
+        UNKNOWN,
+        REQUESTED,
+        KNOWN,
+    };
+
+    void mark(int x, int y) { known_[static_cast<size_t>(y) * tile_.width + x] = KNOWN; }
+
+    const Tile& tile_;
+    int width_;
+    const PixelKernel& kernel_;
+    int* iter_;
+    std::vector<char> known_;
+    std::vector<int> requested_x_;
+    std::vector<int> requested_y_;
+    std::vector<int> results_;
+    long long computed_ = 0;
+};
+
+// Below this many pixels on a side, computing the inside is cheaper than
+// splitting further.
+constexpr int MIN_SUBDIVISION = 4;
+
+// Rectangle (x0, y0)-(x1, y1), corners included.
+struct Rect
+{
+    int x0, y0, x1, y1;
+};
+
+// Mariani-Silver on the whole tile: compute the border of each rectangle,
+// fill the inside if the whole border has one iteration count, and split it
+// in two otherwise. Halves share the splitting line, so it is only computed
+// once. Rectangles are handled a level of splitting at a time, the borders of
+// a whole level computed together, which gives the same pixels as going
+// depth first.
+void subdivide(TileState& state, int width, int height)
+{
+    std::vector<Rect> level = {{0, 0, width - 1, height - 1}};
+    std::vector<Rect> next;
+    while (!level.empty()) {
+        for (const Rect& r : level) {
+            for (int x = r.x0; x <= r.x1; ++x) {
+                state.request(x, r.y0);
+                state.request(x, r.y1);
+            }
+            for (int y = r.y0 + 1; y < r.y1; ++y) {
+                state.request(r.x0, y);
+                state.request(r.x1, y);
+            }
+        }
+        state.flush();
+
+        next.clear();
+        for (const Rect& r : level) {
+            if (r.x1 - r.x0 < 2 || r.y1 - r.y0 < 2)
+                continue;
+
+            const int value = state.at(r.x0, r.y0);
+            bool uniform = true;
+            for (int x = r.x0; x <= r.x1 && uniform; ++x)
+                uniform = state.at(x, r.y0) == value && state.at(x, r.y1) == value;
+            for (int y = r.y0; y <= r.y1 && uniform; ++y)
+                uniform = state.at(r.x0, y) == value && state.at(r.x1, y) == value;
+            if (uniform) {
+                state.fill(r.x0 + 1, r.y0 + 1, r.x1 - 1, r.y1 - 1, value);
+                continue;
+            }
+
+            if (r.x1 - r.x0 < MIN_SUBDIVISION && r.y1 - r.y0 < MIN_SUBDIVISION) {
+                for (int y = r.y0 + 1; y < r.y1; ++y) {
+                    for (int x = r.x0 + 1; x < r.x1; ++x)
+                        state.request(x, y);
+                }
+                continue;
+            }
+
+            // Split across the longer side.
+            if (r.x1 - r.x0 >= r.y1 - r.y0) {
+                const int xm = (r.x0 + r.x1) / 2;
+                next.push_back({r.x0, r.y0, xm, r.y1});
+                next.push_back({xm, r.y0, r.x1, r.y1});
+            }
+            else {
+                const int ym = (r.y0 + r.y1) / 2;
+                next.push_back({r.x0, r.y0, r.x1, ym});
+                next.push_back({r.x0, ym, r.x1, r.y1});
+            }
+        }
+        state.flush();
+        level.swap(next);
+    }
+}
+
+// Boundary tracing: starting from the tile border, every computed pixel
+// that differs from one of its computed neighbours is on the outline of a
+// region, and its neighbours get computed too. The outline spreads along
+// the region boundaries only, the insides are filled from the left. It
+// spreads a step at a time, the neighbours of a whole step computed together.
+void trace_boundaries(TileState& state, int width, int height)
+{
+    std::vector<std::pair<int, int>> step;
+    for (int x = 0; x < width; ++x) {
+        step.emplace_back(x, 0);
+        step.emplace_back(x, height - 1);
+    }
+    for (int y = 1; y < height - 1; ++y) {
+        step.emplace_back(0, y);
+        step.emplace_back(width - 1, y);
+    }
+    for (const auto& p : step)
+        state.request(p.first, p.second);
+    state.flush();
+
+    static const int side[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+    std::vector<std::pair<int, int>> next;
+    while (!step.empty()) {
+        next.clear();
+        for (const auto& p : step) {
+            const int x = p.first;
+            const int y = p.second;
+            const int value = state.at(x, y);
+            bool boundary = false;
+            for (const auto& d : side) {
+                const int nx = x + d[0];
+                const int ny = y + d[1];
+                if (nx >= 0 && ny >= 0 && nx < width && ny < height && state.known(nx, ny) &&
+                    state.at(nx, ny) != value) {
+                    boundary = true;
+                    break;
+                }
+            }
+            if (!boundary)
+                continue;
+
+            // All 8 neighbours, so diagonal filaments do not leak.
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    const int nx = x + dx;
+                    const int ny = y + dy;
+                    if (nx >= 0 && ny >= 0 && nx < width && ny < height && state.request(nx, ny))
+                        next.emplace_back(nx, ny);
+                }
+            }
+        }
+        state.flush();
+        step.swap(next);
+    }
+
+    // Every pixel left is inside a traced outline, its left neighbour is
+    // either that outline or already filled.
+    for (int y = 1; y < height - 1; ++y) {
+        for (int x = 1; x < width - 1; ++x) {
+            if (!state.known(x, y))
+                state.fill(x, y, x, y, state.at(x - 1, y));
+        }
+    }
+}
+
+} // namespace
+
+long long fill_tile(Strategy strategy, const Tile& tile, int width,
+                    const PixelKernel& kernel, int* iter, const unsigned char* keep)
+{
+    TileState state(tile, width, kernel, iter, keep);
+    if (strategy == Strategy::Subdivision) {
+        subdivide(state, tile.width, tile.height);
+    }
+    else if (strategy == Strategy::BoundaryTrace) {
+        trace_boundaries(state, tile.width, tile.height);
+    }
+    else {
+        // Every pixel not kept, in one batch: pixels seeded through keep would
+        // otherwise cut the rows into spans too short for a vector.
+        for (int y = 0; y < tile.height; ++y) {
+            for (int x = 0; x < tile.width; ++x)
+                state.request(x, y);
+        }
+        state.flush();
+    }
+    return state.computed();
+}
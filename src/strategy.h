@@ -0,0 +1,30 @@
+#pragma once
+
+#include <functional>
+
+#include "scheduler.h"
+
+// Which pixels of a tile are iterated. Inside the set and in wide bands of
+// equal iteration, most pixels can be inferred from their neighbours.
+
+enum class Strategy
+{
+    BruteForce,    // every pixel
+    Subdivision,   // Mariani-Silver: rectangles with a uniform border are filled
+    BoundaryTrace, // outlines of equal-iteration regions are traced, insides filled
+};
+
+static constexpr int STRATEGY_COUNT = 3;
+
+const char* strategy_name(Strategy strategy);
+
+// Escape iterations of the count pixels (x[i], y[i]) of the buffer, written
+// to iter[i]. Strategies gather as many pixels per call as they can, so the
+// kernel fills its vectors wherever the pixels are.
+using PixelKernel = std::function<void(const int* x, const int* y, int count, int* iter)>;
+
+// Fill tile of the width pixels wide buffer iter, computing pixels through
+// kernel as strategy decides. Pixels set in keep, laid out like iter, already
+// hold a value and are only read. Returns the number of pixels computed.
+long long fill_tile(Strategy strategy, const Tile& tile, int width,
+                    const PixelKernel& kernel, int* iter, const unsigned char* keep = nullptr);
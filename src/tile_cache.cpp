@@ -0,0 +1,222 @@
+#include "tile_cache.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "tile_store.h"
+
+size_t TileKeyHash::operator()(const TileKey& key) const
+{
+    // 64-bit mix of the fields, tiles of a level are dense around the set.
+    uint64_t h = static_cast<uint64_t>(key.level) * 0x9e3779b97f4a7c15ull;
+    h ^= static_cast<uint64_t>(key.tx) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    h ^= static_cast<uint64_t>(key.ty) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    h ^= static_cast<uint64_t>(key.max_iter) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    return static_cast<size_t>(h);
+}
+
+TileCache::TileCache(size_t budget_bytes, TileStore* store)
+    : store_(store), budget_(budget_bytes)
+{
+}
+
+std::shared_ptr<const CachedTile> TileCache::find(const TileKey& key)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto found = index_.find(key);
+        if (found != index_.end()) {
+            ++hits_;
+            lru_.splice(lru_.begin(), lru_, found->second);
+            return *found->second;
+        }
+    }
+
+    // Disk reads without the lock, other threads keep hitting memory.
+    std::shared_ptr<const CachedTile> tile = store_ ? store_->read(key) : nullptr;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!tile) {
+        ++misses_;
+        return nullptr;
+    }
+    ++disk_hits_;
+    insert_locked(tile);
+    return tile;
+}
+
+void TileCache::insert(std::shared_ptr<const CachedTile> tile)
+{
+    if (store_)
+        store_->append(*tile);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    insert_locked(std::move(tile));
+}
+
+void TileCache::insert_locked(std::shared_ptr<const CachedTile> tile)
+{
+    const auto found = index_.find(tile->key);
+    if (found != index_.end()) {
+        // Rendered twice by concurrent callers, keep the first.
+        lru_.splice(lru_.begin(), lru_, found->second);
+        return;
+    }
+
+    bytes_ += tile->bytes();
+    lru_.push_front(tile);
+    index_.emplace(tile->key, lru_.begin());
+    evict();
+}
+
+void TileCache::evict()
+{
+    while (bytes_ > budget_ && !lru_.empty()) {
+        bytes_ -= lru_.back()->bytes();
+        index_.erase(lru_.back()->key);
+        lru_.pop_back();
+        ++evictions_;
+    }
+}
+
+TileCacheStats TileCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    TileCacheStats stats;
+    stats.hits = hits_;
+    stats.disk_hits = disk_hits_;
+    stats.misses = misses_;
+    stats.evictions = evictions_;
+    stats.tiles = lru_.size();
+    stats.bytes = bytes_;
+    stats.budget = budget_;
+    return stats;
+}
+
+// Size of a pixel of level, exact in double.
+static double level_pixel(int level)
+{
+    return std::ldexp(1.0, -(6 + level));
+}
+
+// Rounds towards minus infinity, for pixels left of or below the origin.
+static int64_t floor_div(int64_t a, int64_t b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+bool tile_grid(const View& view, int& level, int64_t origin[2])
+{
+    // Pixels of the view are 2 / (height * zoom) wide, a power of 2 on a
+    // level.
+    const double size_log2 = (view.zoom * FloatExp(view.height)).log2();
+    const long rounded = std::lround(size_log2);
+    if (std::fabs(size_log2 - rounded) > 1e-9 || rounded - 7 < 0 || rounded - 7 > MAX_TILE_LEVEL)
+        return false;
+    level = static_cast<int>(rounded - 7);
+
+    // The bottom left pixel center is at (origin + 0.5) pixels, on the grid
+    // when the center is half the size of the view away from it.
+    const double pixel = level_pixel(level);
+    const int size[2] = {view.width, view.height};
+    for (int k = 0; k < 2; ++k) {
+        const double index = view.center[k].to_double() / pixel - size[k] / 2.0;
+        origin[k] = static_cast<int64_t>(std::llround(index));
+        const BigFixed grid_center = (static_cast<double>(origin[k]) + size[k] / 2.0) * pixel;
+        if (std::fabs((view.center[k] - grid_center).to_double()) > 1e-6 * pixel)
+            return false;
+    }
+    return true;
+}
+
+View snap_to_tiles(const View& view)
+{
+    View snapped = view;
+    const double size_log2 = (view.zoom * FloatExp(view.height)).log2();
+    const int level = std::clamp(static_cast<int>(std::lround(size_log2)) - 7, 0, MAX_TILE_LEVEL);
+    snapped.zoom = FloatExp::make(1.0, level + 7) / FloatExp(view.height);
+
+    const double pixel = level_pixel(level);
+    const int size[2] = {view.width, view.height};
+    for (int k = 0; k < 2; ++k) {
+        const double index = std::round(view.center[k].to_double() / pixel - size[k] / 2.0);
+        snapped.center[k] = (index + size[k] / 2.0) * pixel;
+    }
+    return snapped;
+}
+
+// Render tile key on its own, as a TILE_PIXELS square view centered on it.
+static std::shared_ptr<const CachedTile> render_tile(const TileKey& key, const RenderOptions& options,
+                                                     RenderStats& render_stats)
+{
+    const double pixel = level_pixel(key.level);
+    View view;
+    view.width = TILE_PIXELS;
+    view.height = TILE_PIXELS;
+    view.max_iter = key.max_iter;
+    view.zoom = FloatExp::make(1.0, key.level - 1);
+    view.center[0] = (static_cast<double>(key.tx) * TILE_PIXELS + TILE_PIXELS / 2) * pixel;
+    view.center[1] = (static_cast<double>(key.ty) * TILE_PIXELS + TILE_PIXELS / 2) * pixel;
+
+    IterBuffer iters;
+    RenderStats tile_stats;
+    render_iterations(view, iters, options, nullptr, &tile_stats);
+    render_stats.pixels += tile_stats.pixels;
+    render_stats.computed += tile_stats.computed;
+    render_stats.interior_skipped += tile_stats.interior_skipped;
+
+    auto tile = std::make_shared<CachedTile>();
+    tile->key = key;
+    tile->iter = std::move(iters.iter);
+    return tile;
+}
+
+bool render_tiled(const View& view, TileCache& cache, IterBuffer& iters,
+                  const RenderOptions& options, RenderStats* render_stats)
+{
+    int level;
+    int64_t origin[2];
+    if (!tile_grid(view, level, origin))
+        return false;
+
+    iters.width = view.width;
+    iters.height = view.height;
+    iters.iter.assign(static_cast<size_t>(view.width) * view.height, 0);
+
+    RenderStats stats;
+
+    const int64_t first[2] = {floor_div(origin[0], TILE_PIXELS), floor_div(origin[1], TILE_PIXELS)};
+    const int64_t last[2] = {floor_div(origin[0] + view.width - 1, TILE_PIXELS),
+                             floor_div(origin[1] + view.height - 1, TILE_PIXELS)};
+    for (int64_t ty = first[1]; ty <= last[1]; ++ty) {
+        for (int64_t tx = first[0]; tx <= last[0]; ++tx) {
+            TileKey key;
+            key.level = level;
+            key.tx = tx;
+            key.ty = ty;
+            key.max_iter = view.max_iter;
+
+            std::shared_ptr<const CachedTile> tile = cache.find(key);
+            if (!tile) {
+                tile = render_tile(key, options, stats);
+                cache.insert(tile);
+            }
+
+            // Part of the tile inside the view, in view pixels.
+            const int64_t tile_x = tx * TILE_PIXELS - origin[0];
+            const int64_t tile_y = ty * TILE_PIXELS - origin[1];
+            const int x0 = static_cast<int>(std::max<int64_t>(tile_x, 0));
+            const int x1 = static_cast<int>(std::min<int64_t>(tile_x + TILE_PIXELS, view.width));
+            const int y0 = static_cast<int>(std::max<int64_t>(tile_y, 0));
+            const int y1 = static_cast<int>(std::min<int64_t>(tile_y + TILE_PIXELS, view.height));
+            for (int y = y0; y < y1; ++y) {
+                const int* row = &tile->iter[static_cast<size_t>(y - tile_y) * TILE_PIXELS + (x0 - tile_x)];
+                std::copy(row, row + (x1 - x0), &iters.iter[static_cast<size_t>(y) * view.width + x0]);
+            }
+        }
+    }
+
+    if (render_stats)
+        *render_stats = stats;
+    return true;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "fractal.h"
+
+class TileStore;
+
+// Iterations cached in a pyramid of square tiles, like map tiles.
+// Level L cuts the plane in pixels of size 2^-(6 + L), 256 of them span 4 at
+// level 0, and tile (tx, ty) of a level holds its pixels
+// [tx * TILE_PIXELS, (tx + 1) * TILE_PIXELS) x [ty * TILE_PIXELS, ...).
+// Views on the pixel grid of a level (see snap_to_tiles()) are put together
+// from tiles, and only tiles never seen before are iterated.
+
+constexpr int TILE_PIXELS = 256;
+
+// Deepest level, where pixel indices around the set still fit in the 53 bits
+// of a double. About zoom 1e11 at 960 rows.
+constexpr int MAX_TILE_LEVEL = 40;
+
+struct TileKey
+{
+    int level = 0;
+    int64_t tx = 0;
+    int64_t ty = 0;
+    int max_iter = 0;
+
+    bool operator==(const TileKey& other) const
+    {
+        return level == other.level && tx == other.tx && ty == other.ty &&
+               max_iter == other.max_iter;
+    }
+};
+
+struct TileKeyHash
+{
+    size_t operator()(const TileKey& key) const;
+};
+
+// Escape iterations of the TILE_PIXELS^2 pixels of a tile, rows bottom to
+// top like IterBuffer.
+struct CachedTile
+{
+    TileKey key;
+    std::vector<int> iter;
+
+    size_t bytes() const { return sizeof(CachedTile) + iter.size() * sizeof(int); }
+};
+
+struct TileCacheStats
+{
+    long long hits = 0;
+    long long disk_hits = 0; // found in the TileStore, not in memory
+    long long misses = 0;
+    long long evictions = 0;
+    size_t tiles = 0;
+    size_t bytes = 0;
+    size_t budget = 0;
+
+    double hit_rate() const
+    {
+        const long long lookups = hits + disk_hits + misses;
+        return lookups ? double(hits + disk_hits) / lookups : 0.0;
+    }
+};
+
+// Least recently used tiles are dropped once the cache holds more than its
+// budget in bytes. Safe to share between threads; tiles handed out stay
+// valid after they are evicted.
+// With a TileStore behind it, tiles missing from memory are looked up on
+// disk, and new tiles are written there too.
+class TileCache
+{
+public:
+    explicit TileCache(size_t budget_bytes, TileStore* store = nullptr);
+
+    // The tile of key, or null. Counts a hit or a miss.
+    std::shared_ptr<const CachedTile> find(const TileKey& key);
+
+    void insert(std::shared_ptr<const CachedTile> tile);
+
+    TileCacheStats stats() const;
+
+private:
+    using Entry = std::list<std::shared_ptr<const CachedTile>>::iterator;
+
+    // Add to memory only, with mutex_ held.
+    void insert_locked(std::shared_ptr<const CachedTile> tile);
+    // Drop from the back of lru_ until bytes_ is within budget.
+    void evict();
+
+    TileStore* store_ = nullptr;
+    mutable std::mutex mutex_;
+    size_t budget_ = 0;
+    size_t bytes_ = 0;
+    std::list<std::shared_ptr<const CachedTile>> lru_; // most recently used first
+    std::unordered_map<TileKey, Entry, TileKeyHash> index_;
+    long long hits_ = 0;
+    long long disk_hits_ = 0;
+    long long misses_ = 0;
+    long long evictions_ = 0;
+};
+
+// Level of the tile grid view is on, and the index of its bottom left pixel
+// in that grid. False when its pixels fall between those of the grid.
+bool tile_grid(const View& view, int& level, int64_t origin[2]);
+
+// View on the nearest level and pixel grid to view: zoom rounded to the
+// level, center moved by less than a pixel.
+View snap_to_tiles(const View& view);
+
+// Render view, which must be on a tile grid, from the tiles of cache.
+// Missing tiles are rendered with options and added to it. Returns false
+// for views off the grid.
+// render_stats counts the pixels of the tiles rendered, whole tiles even
+// where they stick out of view, and none for tiles found in cache.
+bool render_tiled(const View& view, TileCache& cache, IterBuffer& iters,
+                  const RenderOptions& options = RenderOptions(),
+                  RenderStats* render_stats = nullptr);
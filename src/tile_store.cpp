@@ -0,0 +1,432 @@
+#include "tile_store.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char FILE_MAGIC[8] = {'M', 'B', 'T', 'I', 'L', 'E', 'S', '1'};
+
+struct FileHeader
+{
+    char magic[8];
+    uint32_t tile_pixels;
+    uint32_t reserved;
+};
+
+constexpr uint32_t RECORD_MAGIC = 0x454c4954; // "TILE"
+
+struct RecordHeader
+{
+    uint32_t magic;
+    int32_t level;
+    int64_t tx;
+    int64_t ty;
+    int32_t max_iter;
+    uint32_t payload_bytes;
+    uint32_t checksum; // FNV-1a of the key and payload
+    uint32_t reserved;
+};
+
+static_assert(sizeof(FileHeader) == 16 && sizeof(RecordHeader) == 40,
+              "headers are written as they are laid out in memory");
+
+constexpr uint32_t PAYLOAD_BYTES = TILE_PIXELS * TILE_PIXELS * sizeof(int32_t);
+
+uint32_t fnv1a(uint32_t hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+uint32_t record_checksum(const RecordHeader& header, const unsigned char* payload)
+{
+    uint32_t hash = 2166136261u;
+    hash = fnv1a(hash, &header.level, sizeof(header.level));
+    hash = fnv1a(hash, &header.tx, sizeof(header.tx));
+    hash = fnv1a(hash, &header.ty, sizeof(header.ty));
+    hash = fnv1a(hash, &header.max_iter, sizeof(header.max_iter));
+    return fnv1a(hash, payload, header.payload_bytes);
+}
+
+TileKey record_key(const RecordHeader& header)
+{
+    TileKey key;
+    key.level = header.level;
+    key.tx = header.tx;
+    key.ty = header.ty;
+    key.max_iter = header.max_iter;
+    return key;
+}
+
+// Calls visit(key, offset) for each complete record of the mapped file from
+// offset on, and returns the end of the last one. The payload is not
+// checked here, that would read the whole file.
+template <typename Visit>
+uint64_t scan_records(const unsigned char* map, size_t size, uint64_t offset, Visit visit)
+{
+    while (offset + sizeof(RecordHeader) <= size) {
+        RecordHeader header;
+        std::memcpy(&header, map + offset, sizeof(header));
+        if (header.magic != RECORD_MAGIC || header.payload_bytes != PAYLOAD_BYTES)
+            break;
+        const uint64_t end = offset + sizeof(header) + header.payload_bytes;
+        if (end > size)
+            break;
+        visit(record_key(header), offset);
+        offset = end;
+    }
+    return offset;
+}
+
+#ifndef _WIN32
+
+bool write_all(int fd, const void* data, size_t size, uint64_t offset)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    while (size > 0) {
+        const ssize_t written = pwrite(fd, bytes, size, static_cast<off_t>(offset));
+        if (written <= 0)
+            return false;
+        bytes += written;
+        size -= static_cast<size_t>(written);
+        offset += static_cast<uint64_t>(written);
+    }
+    return true;
+}
+
+// Open path, writing the file header if it is new. Returns -1 on failure or
+// for a file that is not a tile pack of this tile size.
+int open_pack(const std::string& path)
+{
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+
+    FileHeader header = {};
+    flock(fd, LOCK_EX);
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    if (ok && st.st_size == 0) {
+        std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+        header.tile_pixels = TILE_PIXELS;
+        ok = write_all(fd, &header, sizeof(header), 0);
+    }
+    else if (ok) {
+        ok = pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) &&
+             std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0 &&
+             header.tile_pixels == TILE_PIXELS;
+    }
+    flock(fd, LOCK_UN);
+
+    if (!ok) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Whether the file at path is no longer the one open as fd.
+bool replaced(int fd, const std::string& path)
+{
+    struct stat open_st, path_st;
+    if (fstat(fd, &open_st) != 0 || stat(path.c_str(), &path_st) != 0)
+        return true;
+    return open_st.st_ino != path_st.st_ino || open_st.st_dev != path_st.st_dev;
+}
+
+#endif
+
+} // namespace
+
+TileStore::~TileStore()
+{
+    close();
+}
+
+#ifndef _WIN32
+
+bool TileStore::open(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    close();
+    fd_ = open_pack(path);
+    if (fd_ < 0)
+        return false;
+    path_ = path;
+    scanned_end_ = sizeof(FileHeader);
+    return scan();
+}
+
+void TileStore::close()
+{
+    if (map_)
+        munmap(const_cast<unsigned char*>(map_), map_size_);
+    if (fd_ >= 0)
+        ::close(fd_);
+    map_ = nullptr;
+    map_size_ = 0;
+    fd_ = -1;
+    scanned_end_ = 0;
+    records_ = 0;
+    index_.clear();
+}
+
+bool TileStore::map_file(size_t size)
+{
+    if (map_)
+        munmap(const_cast<unsigned char*>(map_), map_size_);
+    map_ = nullptr;
+    map_size_ = 0;
+
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED)
+        return false;
+    map_ = static_cast<const unsigned char*>(map);
+    map_size_ = size;
+    return true;
+}
+
+bool TileStore::scan()
+{
+    struct stat st;
+    if (fstat(fd_, &st) != 0)
+        return false;
+    const size_t size = static_cast<size_t>(st.st_size);
+    if (size != map_size_ && !map_file(size))
+        return false;
+
+    // Later records of a key win, like the last append would.
+    scanned_end_ = scan_records(map_, map_size_, scanned_end_, [&](const TileKey& key, uint64_t offset) {
+        index_[key] = offset;
+        ++records_;
+    });
+    return true;
+}
+
+bool TileStore::reopen_if_replaced()
+{
+    if (!replaced(fd_, path_))
+        return true;
+    const std::string path = path_;
+    close();
+    fd_ = open_pack(path);
+    if (fd_ < 0)
+        return false;
+    path_ = path;
+    scanned_end_ = sizeof(FileHeader);
+    return scan();
+}
+
+std::shared_ptr<const CachedTile> TileStore::read(const TileKey& key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ < 0)
+        return nullptr;
+
+    auto found = index_.find(key);
+    if (found == index_.end()) {
+        // Maybe appended by another process since.
+        if (!reopen_if_replaced() || !scan())
+            return nullptr;
+        found = index_.find(key);
+        if (found == index_.end())
+            return nullptr;
+    }
+    // Appended after the file was last mapped.
+    if (found->second + sizeof(RecordHeader) + PAYLOAD_BYTES > map_size_) {
+        if (!scan())
+            return nullptr;
+        found = index_.find(key);
+    }
+
+    RecordHeader header;
+    std::memcpy(&header, map_ + found->second, sizeof(header));
+    const unsigned char* payload = map_ + found->second + sizeof(header);
+    if (record_checksum(header, payload) != header.checksum) {
+        // Torn by a crash, the tile gets rendered and appended again.
+        index_.erase(found);
+        return nullptr;
+    }
+
+    auto tile = std::make_shared<CachedTile>();
+    tile->key = key;
+    tile->iter.resize(TILE_PIXELS * TILE_PIXELS);
+    std::memcpy(tile->iter.data(), payload, PAYLOAD_BYTES);
+    return tile;
+}
+
+bool TileStore::append(const CachedTile& tile)
+{
+    if (tile.iter.size() * sizeof(int32_t) != PAYLOAD_BYTES)
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ < 0)
+        return false;
+
+    // A compaction may put a new file in place while we wait for the lock.
+    for (;;) {
+        if (!reopen_if_replaced())
+            return false;
+        flock(fd_, LOCK_EX);
+        if (!replaced(fd_, path_))
+            break;
+        flock(fd_, LOCK_UN);
+    }
+
+    bool ok = scan();
+    if (ok && index_.count(tile.key) == 0) {
+        // Nobody writes while we hold the lock, bytes past the last complete
+        // record are left from a crash.
+        if (map_size_ > scanned_end_)
+            ok = ftruncate(fd_, static_cast<off_t>(scanned_end_)) == 0;
+
+        std::vector<unsigned char> record(sizeof(RecordHeader) + PAYLOAD_BYTES);
+        RecordHeader header = {};
+        header.magic = RECORD_MAGIC;
+        header.level = tile.key.level;
+        header.tx = tile.key.tx;
+        header.ty = tile.key.ty;
+        header.max_iter = tile.key.max_iter;
+        header.payload_bytes = PAYLOAD_BYTES;
+        std::memcpy(record.data() + sizeof(header), tile.iter.data(), PAYLOAD_BYTES);
+        header.checksum = record_checksum(header, record.data() + sizeof(header));
+        std::memcpy(record.data(), &header, sizeof(header));
+
+        ok = ok && write_all(fd_, record.data(), record.size(), scanned_end_);
+        if (ok) {
+            index_[tile.key] = scanned_end_;
+            scanned_end_ += record.size();
+            ++records_;
+        }
+    }
+    flock(fd_, LOCK_UN);
+    return ok;
+}
+
+TileStoreStats TileStore::stats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    TileStoreStats stats;
+    stats.tiles = index_.size();
+    stats.records = records_;
+    stats.file_bytes = scanned_end_;
+    return stats;
+}
+
+bool compact_tile_store(const std::string& path, TileStoreStats* before, TileStoreStats* after)
+{
+    // Another compaction may put a new file in place while we wait for the
+    // lock, like in TileStore::append().
+    int fd;
+    for (;;) {
+        fd = open_pack(path);
+        if (fd < 0)
+            return false;
+        flock(fd, LOCK_EX);
+        if (!replaced(fd, path))
+            break;
+        flock(fd, LOCK_UN);
+        ::close(fd);
+    }
+
+    bool ok = false;
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0)
+        map = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+
+    if (map != MAP_FAILED) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(map);
+        const size_t size = static_cast<size_t>(st.st_size);
+
+        std::vector<std::pair<TileKey, uint64_t>> records;
+        scan_records(bytes, size, sizeof(FileHeader), [&](const TileKey& key, uint64_t offset) {
+            records.emplace_back(key, offset);
+        });
+
+        // Newest record of each key whose checksum holds, so an older copy
+        // still serves when the last one is torn. Kept in file order.
+        std::unordered_map<TileKey, bool, TileKeyHash> found;
+        std::vector<uint64_t> offsets;
+        for (auto record = records.rbegin(); record != records.rend(); ++record) {
+            bool& kept = found[record->first];
+            if (kept)
+                continue;
+            RecordHeader header;
+            std::memcpy(&header, bytes + record->second, sizeof(header));
+            if (record_checksum(header, bytes + record->second + sizeof(header)) != header.checksum)
+                continue;
+            kept = true;
+            offsets.push_back(record->second);
+        }
+        std::sort(offsets.begin(), offsets.end());
+
+        if (before) {
+            before->tiles = found.size();
+            before->records = records.size();
+            before->file_bytes = size;
+        }
+
+        // Written beside it and renamed over it, so readers only ever see
+        // one whole file or the other.
+        std::string temp_path = path + ".compact-XXXXXX";
+        const int out = mkstemp(&temp_path[0]);
+        ok = out >= 0 && fchmod(out, 0644) == 0 && write_all(out, bytes, sizeof(FileHeader), 0);
+        uint64_t out_size = sizeof(FileHeader);
+        for (size_t i = 0; ok && i < offsets.size(); ++i) {
+            const size_t record_size = sizeof(RecordHeader) + PAYLOAD_BYTES;
+            ok = write_all(out, bytes + offsets[i], record_size, out_size);
+            out_size += record_size;
+        }
+        ok = ok && fsync(out) == 0;
+        if (out >= 0)
+            ::close(out);
+        ok = ok && std::rename(temp_path.c_str(), path.c_str()) == 0;
+        if (!ok && out >= 0)
+            std::remove(temp_path.c_str());
+
+        if (ok && after) {
+            after->tiles = offsets.size();
+            after->records = offsets.size();
+            after->file_bytes = out_size;
+        }
+        munmap(map, size);
+    }
+
+    flock(fd, LOCK_UN);
+    ::close(fd);
+    return ok;
+}
+
+#else
+
+bool TileStore::open(const std::string&) { return false; }
+void TileStore::close() {}
+bool TileStore::map_file(size_t) { return false; }
+bool TileStore::scan() { return false; }
+bool TileStore::reopen_if_replaced() { return false; }
+std::shared_ptr<const CachedTile> TileStore::read(const TileKey&) { return nullptr; }
+bool TileStore::append(const CachedTile&) { return false; }
+TileStoreStats TileStore::stats() { return TileStoreStats(); }
+
+bool compact_tile_store(const std::string&, TileStoreStats*, TileStoreStats*)
+{
+    return false;
+}
+
+#endif
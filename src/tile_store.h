@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "tile_cache.h"
+
+// Tiles of the cache kept on disk in a single pack file, so later runs and
+// other processes find them computed.
+// The file is a header followed by records appended one after the other:
+// a fixed record header (key, payload size, checksum) and the tile
+// iterations as int32 in host byte order. Records are never changed once
+// written. The index of where each tile is gets rebuilt by reading the
+// record headers, and picks up records other processes append.
+// Reads go through a memory mapping of the file. Appends hold an exclusive
+// flock() on it, so several render workers can add tiles at the same time.
+// A record left half written by a crash is cut off by the next append.
+// POSIX only; open() fails elsewhere.
+
+struct TileStoreStats
+{
+    size_t tiles = 0;      // distinct tiles indexed
+    size_t records = 0;    // records in the file, duplicates included
+    size_t file_bytes = 0;
+};
+
+class TileStore
+{
+public:
+    TileStore() = default;
+    ~TileStore();
+    TileStore(const TileStore&) = delete;
+    TileStore& operator=(const TileStore&) = delete;
+
+    // Open the pack at path, creating it if it does not exist.
+    bool open(const std::string& path);
+    void close();
+
+    // Tile of key, or null if the pack does not have it.
+    std::shared_ptr<const CachedTile> read(const TileKey& key);
+
+    // Add tile at the end of the pack, unless it is there already.
+    bool append(const CachedTile& tile);
+
+    TileStoreStats stats();
+
+private:
+    // Open path again if it was replaced by a compaction since.
+    bool reopen_if_replaced();
+    // Map the file as it is now, and index the records past scanned_end_.
+    bool scan();
+    bool map_file(size_t size);
+
+    std::mutex mutex_;
+    std::string path_;
+    int fd_ = -1;
+    const unsigned char* map_ = nullptr;
+    size_t map_size_ = 0;
+    uint64_t scanned_end_ = 0; // end of the last complete record indexed
+    size_t records_ = 0;
+    std::unordered_map<TileKey, uint64_t, TileKeyHash> index_; // record offsets
+};
+
+// Rewrite the pack at path with one record per tile, the newest one whose
+// checksum holds, and no torn tail, then put it in place of the old one. Appends wait while it runs, and
+// processes that had it open move to the new file on their next append.
+bool compact_tile_store(const std::string& path, TileStoreStats* before = nullptr,
+                        TileStoreStats* after = nullptr);
@@ -0,0 +1,101 @@
+#include "y4m_writer.h"
+
+#include <algorithm>
+
+// BT.601 limited range, in the usual 8 bit fixed point.
+static uint8_t luma(int r, int g, int b)
+{
+    return static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+static uint8_t chroma_blue(int r, int g, int b)
+{
+    return static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+}
+
+static uint8_t chroma_red(int r, int g, int b)
+{
+    return static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+Y4mWriter::~Y4mWriter()
+{
+    close();
+}
+
+bool Y4mWriter::open(const std::string& file, int width, int height, int fps)
+{
+    if (file_ || width <= 0 || height <= 0 || fps <= 0)
+        return false;
+    file_ = file == "-" ? stdout : std::fopen(file.c_str(), "wb");
+    if (!file_)
+        return false;
+
+    failed_ = false;
+    width_ = width;
+    height_ = height;
+    const size_t chroma = static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2);
+    planes_.resize(static_cast<size_t>(width) * height + 2 * chroma);
+    failed_ |= std::fprintf(file_, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps) < 0;
+    return !failed_;
+}
+
+bool Y4mWriter::write_frame(const unsigned char* rgb)
+{
+    if (!file_)
+        return false;
+
+    // Video rows go top to bottom, the last row of rgb first.
+    auto pixel = [&](int x, int y) { return rgb + (static_cast<size_t>(height_ - 1 - y) * width_ + x) * 3; };
+
+    uint8_t* y_plane = planes_.data();
+    for (int y = 0; y < height_; ++y) {
+        for (int x = 0; x < width_; ++x) {
+            const unsigned char* p = pixel(x, y);
+            y_plane[static_cast<size_t>(y) * width_ + x] = luma(p[0], p[1], p[2]);
+        }
+    }
+
+    // Chroma of the average color of each 2x2 block, or of what is left of
+    // it on the right and bottom edges.
+    const int chroma_width = (width_ + 1) / 2;
+    const int chroma_height = (height_ + 1) / 2;
+    uint8_t* u_plane = y_plane + static_cast<size_t>(width_) * height_;
+    uint8_t* v_plane = u_plane + static_cast<size_t>(chroma_width) * chroma_height;
+    for (int cy = 0; cy < chroma_height; ++cy) {
+        for (int cx = 0; cx < chroma_width; ++cx) {
+            int sum[3] = {0, 0, 0};
+            int count = 0;
+            for (int y = 2 * cy; y < std::min(2 * cy + 2, height_); ++y) {
+                for (int x = 2 * cx; x < std::min(2 * cx + 2, width_); ++x) {
+                    const unsigned char* p = pixel(x, y);
+                    for (int k = 0; k < 3; ++k)
+                        sum[k] += p[k];
+                    ++count;
+                }
+            }
+            const int r = (sum[0] + count / 2) / count;
+            const int g = (sum[1] + count / 2) / count;
+            const int b = (sum[2] + count / 2) / count;
+            const size_t i = static_cast<size_t>(cy) * chroma_width + cx;
+            u_plane[i] = chroma_blue(r, g, b);
+            v_plane[i] = chroma_red(r, g, b);
+        }
+    }
+
+    failed_ |= std::fputs("FRAME\n", file_) < 0;
+    failed_ |= std::fwrite(planes_.data(), 1, planes_.size(), file_) != planes_.size();
+    return !failed_;
+}
+
+bool Y4mWriter::close()
+{
+    if (!file_)
+        return false;
+    if (file_ == stdout)
+        failed_ |= std::fflush(file_) != 0;
+    else
+        failed_ |= std::fclose(file_) != 0;
+    file_ = nullptr;
+    return !failed_;
+}
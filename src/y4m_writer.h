@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Raw YUV4MPEG2 video, which ffmpeg, x264 and most encoders read from a pipe:
+//     render --animate 300 - | ffmpeg -i - zoom.mp4
+// Frames are 4:2:0 in BT.601 limited range, the colorspace encoders take
+// without converting. Odd sizes round the chroma planes up.
+
+class Y4mWriter
+{
+public:
+    Y4mWriter() = default;
+    ~Y4mWriter();
+    Y4mWriter(const Y4mWriter&) = delete;
+    Y4mWriter& operator=(const Y4mWriter&) = delete;
+
+    // Start a video of width x height pixels at fps frames per second, in
+    // file or on standard output for "-".
+    bool open(const std::string& file, int width, int height, int fps);
+
+    // Next frame, 3 bytes per pixel, rows bottom to top like IterBuffer.
+    bool write_frame(const unsigned char* rgb);
+
+    // False if anything failed to be written.
+    bool close();
+
+private:
+    std::FILE* file_ = nullptr;
+    bool failed_ = false;
+    int width_ = 0;
+    int height_ = 0;
+    std::vector<uint8_t> planes_; // Y, U and V of one frame
+};